@@ -21,9 +21,9 @@
  * You can verify this for yourself using gcc -v.
  *******************************************************/
 
-#if defined(__i386__)  
+#if defined(__i386__) || defined(__x86_64__)
 /*******************************************************
- * Pentium versions of start_counter() and get_counter()
+ * x86 (32 and 64-bit) versions of start_counter() and get_counter()
  *******************************************************/
 
 
@@ -37,10 +37,8 @@ static unsigned cyc_lo = 0;
    Implementation requires assembly code to use the rdtsc instruction. */
 void access_counter(unsigned *hi, unsigned *lo)
 {
-    asm("rdtsc; movl %%edx,%0; movl %%eax,%1"   /* Read cycle counter */
-	: "=r" (*hi), "=r" (*lo)                /* and move results to */
-	: /* No input */                        /* the two outputs */
-	: "%edx", "%eax");
+    asm volatile("rdtsc"                       /* Read cycle counter */
+	: "=d" (*hi), "=a" (*lo));              /* edx:eax -> hi:lo */
 }
 
 /* Record the current value of the cycle counter. */
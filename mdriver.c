@@ -14,12 +14,19 @@
 #include <string.h>
 #include <assert.h>
 #include <float.h>
+#include <stdint.h>
 #include <time.h>
 
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "ftimer.h"
 #include "config.h"
+#include "mm_registry.h"
+#ifdef MM_THREAD_SAFE
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 /**********************
  * Constants and macros
@@ -29,9 +36,18 @@
 #define MAXLINE     1024 /* max string size */
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
+#define HEAP_SAMPLES  20 /* heap size samples per trace with -H */
+
+/* Producer/consumer benchmark (-P) */
+#define PC_MSGS 200000   /* messages per producer */
+#define PC_RING   1024   /* slots in each producer->consumer ring */
+#define PC_MAXPAIRS  8   /* largest number of producer/consumer pairs */
+
+/* True if the allocator under test is mm.c, with the rest of the mm.h API */
+#define FULL_MM (alloc == mm_allocators)
 
 /* Returns true if p is ALIGNMENT-byte aligned */
-#define IS_ALIGNED(p)  ((((unsigned int)(p)) % ALIGNMENT) == 0)
+#define IS_ALIGNED(p)  ((((uintptr_t)(p)) % ALIGNMENT) == 0)
 
 /****************************** 
  * The key compound data types 
@@ -46,9 +62,13 @@ typedef struct range_t {
 
 /* Characterizes a single trace operation (allocator request) */
 typedef struct {
-    enum {ALLOC, FREE, REALLOC} type; /* type of request */
+    enum {ALLOC, FREE, REALLOC, CALLOC, MEMALIGN,
+	  BALLOC, BFREE} type;        /* type of request */
     int index;                        /* index for free() to use later */
     int size;                         /* byte size of alloc/realloc request */
+    int arg;                          /* calloc count, memalign alignment, */
+                                      /* or batch count (ids index..+arg-1) */
+                                      /* free: size for mm_free_sized, or 0 */
 } traceop_t;
 
 /* Holds the information for one trace file*/
@@ -85,11 +105,42 @@ typedef struct {
     /* Note: secs and util are only defined if valid is true */
 } stats_t; 
 
+/* Holds the params to heaps_run, which is timed by ftimer */
+typedef struct {
+    trace_t **traces;   /* one trace per heap */
+    int n;              /* number of traces */
+    int bad;            /* set if a payload was found overwritten */
+} heaps_t;
+
+#ifdef MM_THREAD_SAFE
+/*
+ * A single-producer single-consumer ring that carries messages from
+ * one producer thread to its consumer thread
+ */
+typedef struct {
+    char *slot[PC_RING];
+    unsigned head;      /* next slot the producer fills */
+    unsigned tail;      /* next slot the consumer empties */
+    int libc;           /* use libc malloc/free instead of mm */
+    unsigned seed;      /* producer's random seed for message sizes */
+} ring_t;
+
+/* Holds the params to prodcons_run, which is timed by ftimer */
+typedef struct {
+    int pairs;          /* number of producer/consumer thread pairs */
+    int libc;           /* use libc malloc/free instead of mm */
+} prodcons_t;
+#endif
+
 /********************
  * Global variables
  *******************/
 int verbose = 0;        /* global flag for verbose output */
+static int heap_report = 0; /* print heap size over time (set by -H) */
+static int sized_free = 0;  /* free with mm_free_sized (set by -S) */
 static int errors = 0;  /* number of errs found when running student malloc */
+static const mm_allocator_t *alloc = mm_allocators; /* allocator under test (-m) */
+static int run_all = 0;     /* evaluate every registered allocator (-m all) */
 char msg[MAXLINE];      /* for whenever we need to compose an error message */
 
 /* Directory where default tracefiles are found */
@@ -118,14 +169,33 @@ static void free_trace(trace_t *trace);
 /* Routines for evaluating the correctness and speed of libc malloc */
 static int eval_libc_valid(trace_t *trace, int tracenum);
 static void eval_libc_speed(void *ptr);
+static char *libc_alloc_op(traceop_t *op);
 
 /* Routines for evaluating correctnes, space utilization, and speed 
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
 static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
 static void eval_mm_speed(void *ptr);
+static char *mm_alloc_op(traceop_t *op);
+static void mm_free_op(traceop_t *op, char *p);
+static void eval_pages(char **tracefiles, int num_tracefiles);
+static void eval_heaps(char **tracefiles, int num_tracefiles);
+static void eval_guard(char **tracefiles, int num_tracefiles);
+static void heaps_run(void *ptr);
+static void heap_op(mm_heap_t *h, trace_t *trace, int i, int *bad);
+
+#ifdef MM_THREAD_SAFE
+/* Producer/consumer benchmark: every mm_free comes from another thread */
+static void eval_prodcons(void);
+static void prodcons_run(void *ptr);
+static void *producer(void *arg);
+static void *consumer(void *arg);
+#endif
 
 /* Various helper routines */
+static void eval_allocator(char **tracefiles, int num_tracefiles,
+			   int stats_format, int autograder);
+static int basic_trace(trace_t *trace);
 static void printresults(int n, stats_t *stats);
 static void usage(void);
 static void unix_error(char *msg);
@@ -142,23 +212,24 @@ int main(int argc, char **argv)
     char **tracefiles = NULL;  /* null-terminated array of trace file names */
     int num_tracefiles = 0;    /* the number of traces in that array */
     trace_t *trace = NULL;     /* stores a single trace file in memory */
-    range_t *ranges = NULL;    /* keeps track of block extents for one trace */
     stats_t *libc_stats = NULL;/* libc stats for each trace */
-    stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
     speed_t speed_params;      /* input parameters to the xx_speed routines */ 
 
     int team_check = 1;  /* If set, check team structure (reset by -a) */
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+    int page_report = 0; /* If set, compare heap page sizes per trace (-T) */
+    int side_by_side = 0;/* If set, run all traces at once in separate heaps (-I) */
+    int guard_report = 0;/* If set, time each trace at several guard sample rates (-G) */
+    int stats_format = -1;/* If set, dump mm_stats_print after each trace (-s) */
+#ifdef MM_THREAD_SAFE
+    int prodcons = 0;    /* If set, run the producer/consumer benchmark (-P) */
+#endif
 
-    /* temporaries used to compute the performance index */
-    double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
-    int numcorrect;
-    
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt(argc, argv, "f:t:hvVgalHDSPTIGC:s:m:")) != EOF) {
         switch (c) {
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
@@ -184,6 +255,52 @@ int main(int argc, char **argv)
         case 'l': /* Run libc malloc */
             run_libc = 1;
             break;
+        case 'H': /* Print heap size over time for each trace */
+            heap_report = 1;
+            break;
+        case 'D': /* Defer coalescing in mm_free */
+            mm_mallopt(MM_DEFER_COALESCE, 1);
+            break;
+        case 'S': /* Pass the block size to the allocator on free */
+            sized_free = 1;
+            break;
+        case 'C': /* Check the heap in mm.c as it changes */
+            if (!mm_mallopt(MM_CHECK_HEAP, atoi(optarg)))
+		app_error("-C takes 0 (off), 1 (touched blocks) or 2 (whole heap)");
+            break;
+        case 's': /* Dump the allocator statistics after each trace */
+            if (strcmp(optarg, "text") == 0)
+		stats_format = MM_STATS_TEXT;
+            else if (strcmp(optarg, "json") == 0)
+		stats_format = MM_STATS_JSON;
+            else
+		app_error("-s takes text or json");
+            mm_mallopt(MM_STATS, 1);
+            break;
+        case 'm': /* Pick the allocator, or all of them */
+            if (strcmp(optarg, "all") == 0)
+		run_all = 1;
+            else if ((alloc = mm_allocator_find(optarg)) == NULL) {
+		sprintf(msg, "-m: no allocator called %s (see -h)", optarg);
+		app_error(msg);
+	    }
+            break;
+        case 'G': /* Time each trace with sampled guard pages */
+            guard_report = 1;
+            break;
+        case 'I': /* Run the traces side by side, one heap instance each */
+            side_by_side = 1;
+            break;
+        case 'T': /* Time each trace with base pages and huge pages */
+            page_report = 1;
+            break;
+        case 'P': /* Run the producer/consumer benchmark instead of traces */
+#ifdef MM_THREAD_SAFE
+            prodcons = 1;
+            break;
+#else
+            app_error("-P needs mm.c built with -DMM_THREAD_SAFE");
+#endif
         case 'v': /* Print per-trace performance breakdown */
             verbose = 1;
             break;
@@ -225,6 +342,13 @@ int main(int argc, char **argv)
 	    printf("Member 2 :%s:%s\n", team.name2, team.id2);
     }
 
+#ifdef MM_THREAD_SAFE
+    if (prodcons) {
+	eval_prodcons();
+	exit(0);
+    }
+#endif
+
     /* 
      * If no -f command line arg, then use the entire set of tracefiles 
      * defined in default_traces[]
@@ -273,27 +397,85 @@ int main(int argc, char **argv)
 	}
     }
 
+    /* Initialize the simulated memory system in memlib.c */
+    mem_init(); 
+
     /*
-     * Always run and evaluate the student's mm package
+     * Always run and evaluate the student's mm package, or the
+     * allocators picked with -m
      */
-    if (verbose > 1)
-	printf("\nTesting mm malloc\n");
+    if (run_all) {
+	for (alloc = mm_allocators; alloc->name != NULL; alloc++)
+	    eval_allocator(tracefiles, num_tracefiles, stats_format, autograder);
+	alloc = mm_allocators;
+    }
+    else
+	eval_allocator(tracefiles, num_tracefiles, stats_format, autograder);
+
+    /* Optionally compare the throughput on each kind of heap page */
+    if (page_report)
+	eval_pages(tracefiles, num_tracefiles);
+
+    /* Optionally measure the cost of sampled guard pages */
+    if (guard_report)
+	eval_guard(tracefiles, num_tracefiles);
+
+    /* Optionally run every trace at once, each in its own heap */
+    if (side_by_side)
+	eval_heaps(tracefiles, num_tracefiles);
+
+    exit(0);
+}
+
+
+/*
+ * eval_allocator - Check, measure and score the allocator under test
+ *     (alloc) on every trace, and print its performance index
+ */
+static void eval_allocator(char **tracefiles, int num_tracefiles,
+			   int stats_format, int autograder)
+{
+    int i;
+    trace_t *trace = NULL;     /* stores a single trace file in memory */
+    range_t *ranges = NULL;    /* keeps track of block extents for one trace */
+    stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
+    speed_t speed_params;      /* input parameters to the xx_speed routines */ 
+    int errors_before = errors;
+
+    /* temporaries used to compute the performance index */
+    double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
+    int numcorrect;
+
+    if (run_all || !FULL_MM || verbose > 1)
+	printf("\nTesting %s malloc\n", alloc->name);
 
     /* Allocate the mm stats array, with one stats_t struct per tracefile */
     mm_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
     if (mm_stats == NULL)
-	unix_error("mm_stats calloc in main failed");
-    
-    /* Initialize the simulated memory system in memlib.c */
-    mem_init(); 
+	unix_error("mm_stats calloc in eval_allocator failed");
 
-    /* Evaluate student's mm malloc package using the K-best scheme */
+    /* Evaluate the allocator using the K-best scheme */
     for (i=0; i < num_tracefiles; i++) {
 	trace = read_trace(tracedir, tracefiles[i]);
 	mm_stats[i].ops = trace->num_ops;
+	if (!FULL_MM && !basic_trace(trace)) {
+	    sprintf(msg, "%s has only malloc, free and realloc", alloc->name);
+	    malloc_error(i, 0, msg);
+	    free_trace(trace);
+	    continue;
+	}
 	if (verbose > 1)
 	    printf("Checking mm_malloc for correctness, ");
 	mm_stats[i].valid = eval_mm_valid(trace, i, &ranges);
+	if (FULL_MM && mm_stats[i].valid && stats_format == MM_STATS_JSON) {
+	    printf("{\"trace\":\"%s\",\"stats\":", tracefiles[i]);
+	    fflush(stdout);
+	    mm_stats_print(stdout, MM_STATS_JSON);
+	    printf("}\n");
+	} else if (FULL_MM && mm_stats[i].valid && stats_format == MM_STATS_TEXT) {
+	    printf("Allocator statistics for %s:\n", tracefiles[i]);
+	    mm_stats_print(stdout, MM_STATS_TEXT);
+	}
 	if (mm_stats[i].valid) {
 	    if (verbose > 1)
 		printf("efficiency, ");
@@ -306,10 +488,11 @@ int main(int argc, char **argv)
 	}
 	free_trace(trace);
     }
+    clear_ranges(&ranges);
 
     /* Display the mm results in a compact table */
     if (verbose) {
-	printf("\nResults for mm malloc:\n");
+	printf("\nResults for %s malloc:\n", alloc->name);
 	printresults(num_tracefiles, mm_stats);
 	printf("\n");
     }
@@ -329,11 +512,12 @@ int main(int argc, char **argv)
 	    numcorrect++;
     }
     avg_mm_util = util/num_tracefiles;
+    free(mm_stats);
 
     /* 
      * Compute and print the performance index 
      */
-    if (errors == 0) {
+    if (errors == errors_before) {
 	avg_mm_throughput = ops/secs;
 
 	p1 = UTIL_WEIGHT * avg_mm_util;
@@ -354,17 +538,29 @@ int main(int argc, char **argv)
     }
     else { /* There were errors */
 	perfindex = 0.0;
-	printf("Terminated with %d errors\n", errors);
+	printf("Terminated with %d errors\n", errors - errors_before);
     }
 
     if (autograder) {
 	printf("correct:%d\n", numcorrect);
 	printf("perfidx:%.0f\n", perfindex);
     }
-
-    exit(0);
 }
 
+/*
+ * basic_trace - Return true if the trace uses only malloc, free and
+ *     realloc requests, the part of mm.h every registered allocator has
+ */
+static int basic_trace(trace_t *trace)
+{
+    int i;
+
+    for (i = 0; i < trace->num_ops; i++)
+	if (trace->ops[i].type != ALLOC && trace->ops[i].type != FREE &&
+	    trace->ops[i].type != REALLOC)
+	    return 0;
+    return 1;
+}
 
 /*****************************************************************
  * The following routines manipulate the range list, which keeps 
@@ -395,15 +591,24 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
     }
 
-    /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
-	(hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+    /* The payload must lie within the extent of the heap or of a mapping */
+    if (((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
+	 (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) &&
+	!mem_is_mapped(lo, hi)) {
 	sprintf(msg, "Payload (%p:%p) lies outside heap (%p:%p)",
 		lo, hi, mem_heap_lo(), mem_heap_hi());
 	malloc_error(tracenum, opnum, msg);
         return 0;
     }
 
+    /* The allocator must report at least the requested payload as usable */
+    if (alloc->usable_size != NULL && alloc->usable_size(lo) < (size_t)size) {
+	sprintf(msg, "mm_usable_size (%lu) is less than the payload size (%d)",
+		(unsigned long)alloc->usable_size(lo), size);
+	malloc_error(tracenum, opnum, msg);
+	return 0;
+    }
+
     /* The payload must not overlap any other payloads */
     for (p = *ranges;  p != NULL;  p = p->next) {
         if ((lo >= p->lo && lo <= p-> hi) ||
@@ -477,7 +682,7 @@ static trace_t *read_trace(char *tracedir, char *filename)
     trace_t *trace;
     char type[MAXLINE];
     char path[MAXLINE];
-    unsigned index, size;
+    unsigned index, size, arg, j;
     unsigned max_index = 0;
     unsigned op_index;
 
@@ -515,7 +720,11 @@ static trace_t *read_trace(char *tracedir, char *filename)
 	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
 	unix_error("malloc 4 failed in read_trace");
     
-    /* read every request line in the trace file */
+    /* 
+     * read every request line in the trace file. block_sizes holds the
+     * live size of each id while reading, so that every free can carry
+     * it for mm_free_sized (0 after memalign, which needs plain mm_free)
+     */
     index = 0;
     op_index = 0;
     while (fscanf(tracefile, "%s", type) != EOF) {
@@ -525,6 +734,7 @@ static trace_t *read_trace(char *tracedir, char *filename)
 	    trace->ops[op_index].type = ALLOC;
 	    trace->ops[op_index].index = index;
 	    trace->ops[op_index].size = size;
+	    trace->block_sizes[index] = size;
 	    max_index = (index > max_index) ? index : max_index;
 	    break;
 	case 'r':
@@ -532,12 +742,54 @@ static trace_t *read_trace(char *tracedir, char *filename)
 	    trace->ops[op_index].type = REALLOC;
 	    trace->ops[op_index].index = index;
 	    trace->ops[op_index].size = size;
+	    trace->block_sizes[index] = size;
+	    max_index = (index > max_index) ? index : max_index;
+	    break;
+	case 'c': /* c <id> <nmemb> <size>: calloc, size is nmemb * size */
+	    fscanf(tracefile, "%u %u %u", &index, &arg, &size);
+	    if (arg == 0) { /* the evaluators divide by nmemb */
+		printf("calloc with 0 members (id %u) in tracefile %s\n",
+		       index, path);
+		exit(1);
+	    }
+	    trace->ops[op_index].type = CALLOC;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].size = arg * size;
+	    trace->ops[op_index].arg = arg;
+	    trace->block_sizes[index] = arg * size;
+	    max_index = (index > max_index) ? index : max_index;
+	    break;
+	case 'm': /* m <id> <align> <size>: memalign */
+	    fscanf(tracefile, "%u %u %u", &index, &arg, &size);
+	    trace->ops[op_index].type = MEMALIGN;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].size = size;
+	    trace->ops[op_index].arg = arg;
+	    trace->block_sizes[index] = 0;
 	    max_index = (index > max_index) ? index : max_index;
 	    break;
+	case 'b': /* b <id> <n> <size>: batch malloc of ids id..id+n-1 */
+	    fscanf(tracefile, "%u %u %u", &index, &arg, &size);
+	    trace->ops[op_index].type = BALLOC;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].size = size;
+	    trace->ops[op_index].arg = arg;
+	    for (j = index; j < index + arg; j++)
+		trace->block_sizes[j] = size;
+	    index += arg - 1;
+	    max_index = (index > max_index) ? index : max_index;
+	    break;
+	case 'B': /* B <id> <n>: batch free of ids id..id+n-1 */
+	    fscanf(tracefile, "%u %u", &index, &arg);
+	    trace->ops[op_index].type = BFREE;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].arg = arg;
+	    break;
 	case 'f':
 	    fscanf(tracefile, "%ud", &index);
 	    trace->ops[op_index].type = FREE;
 	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].arg = trace->block_sizes[index];
 	    break;
 	default:
 	    printf("Bogus type character (%c) in tracefile %s\n", 
@@ -579,6 +831,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
     int i, j;
     int index;
     int size;
+    int arg;
     int oldsize;
     char *newp;
     char *oldp;
@@ -589,7 +842,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
     clear_ranges(ranges);
 
     /* Call the mm package's init function */
-    if (mm_init() < 0) {
+    if (alloc->init() < 0) {
 	malloc_error(tracenum, 0, "mm_init failed.");
 	return 0;
     }
@@ -604,7 +857,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
         case ALLOC: /* mm_malloc */
 
 	    /* Call the student's malloc */
-	    if ((p = mm_malloc(size)) == NULL) {
+	    if ((p = alloc->malloc(size)) == NULL) {
 		malloc_error(tracenum, i, "mm_malloc failed.");
 		return 0;
 	    }
@@ -629,11 +882,74 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    trace->block_sizes[index] = size;
 	    break;
 
+        case CALLOC: /* mm_calloc */
+	    arg = trace->ops[i].arg;
+	    if ((p = mm_calloc(arg, size / arg)) == NULL) {
+		malloc_error(tracenum, i, "mm_calloc failed.");
+		return 0;
+	    }
+	    if (add_range(ranges, p, size, tracenum, i) == 0)
+		return 0;
+
+	    /* The whole payload must come back zeroed */
+	    for (j = 0; j < size; j++) {
+		if (p[j] != 0) {
+		    malloc_error(tracenum, i, "mm_calloc did not zero the block");
+		    return 0;
+		}
+	    }
+	    memset(p, index & 0xFF, size);
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    break;
+
+        case MEMALIGN: /* mm_memalign */
+	    arg = trace->ops[i].arg;
+	    if ((p = mm_memalign(arg, size)) == NULL) {
+		malloc_error(tracenum, i, "mm_memalign failed.");
+		return 0;
+	    }
+	    if (((uintptr_t)p % arg) != 0) {
+		sprintf(msg, "mm_memalign payload (%p) not aligned to %d bytes",
+			p, arg);
+		malloc_error(tracenum, i, msg);
+		return 0;
+	    }
+	    if (add_range(ranges, p, size, tracenum, i) == 0)
+		return 0;
+	    memset(p, index & 0xFF, size);
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    break;
+
+        case BALLOC: /* mm_malloc_batch */
+	    arg = trace->ops[i].arg;
+	    if (mm_malloc_batch(size, arg, (void **)&trace->blocks[index])
+		!= (size_t)arg) {
+		malloc_error(tracenum, i, "mm_malloc_batch failed.");
+		return 0;
+	    }
+	    for (j = index; j < index + arg; j++) {
+		p = trace->blocks[j];
+		if (add_range(ranges, p, size, tracenum, i) == 0)
+		    return 0;
+		memset(p, j & 0xFF, size);
+		trace->block_sizes[j] = size;
+	    }
+	    break;
+
+        case BFREE: /* mm_free_batch */
+	    arg = trace->ops[i].arg;
+	    for (j = index; j < index + arg; j++)
+		remove_range(ranges, trace->blocks[j]);
+	    mm_free_batch((void **)&trace->blocks[index], arg);
+	    break;
+
         case REALLOC: /* mm_realloc */
 	    
 	    /* Call the student's realloc */
 	    oldp = trace->blocks[index];
-	    if ((newp = mm_realloc(oldp, size)) == NULL) {
+	    if ((newp = alloc->realloc(oldp, size)) == NULL) {
 		malloc_error(tracenum, i, "mm_realloc failed.");
 		return 0;
 	    }
@@ -653,7 +969,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    oldsize = trace->block_sizes[index];
 	    if (size < oldsize) oldsize = size;
 	    for (j = 0; j < oldsize; j++) {
-	      if (newp[j] != (index & 0xFF)) {
+	      if (newp[j] != (char)(index & 0xFF)) {
 		malloc_error(tracenum, i, "mm_realloc did not preserve the "
 			     "data from old block");
 		return 0;
@@ -671,7 +987,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    /* Remove region from list and call student's free function */
 	    p = trace->blocks[index];
 	    remove_range(ranges, p);
-	    mm_free(p);
+	    mm_free_op(&trace->ops[i], p);
 	    break;
 
 	default:
@@ -680,6 +996,12 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 
     }
 
+    /* The allocator's own view of the heap must agree as well */
+    if (alloc->checkheap != NULL && alloc->checkheap(0) < 0) {
+	malloc_error(tracenum, trace->num_ops - 1, "mm_checkheap found an inconsistent heap.");
+	return 0;
+    }
+
     /* As far as we know, this is a valid malloc package */
     return 1;
 }
@@ -689,35 +1011,42 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
  *   The idea is to remember the high water mark "hwm" of the heap for 
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the 
- *   size of the heap in bytes after running the student's malloc 
- *   package on the trace. Note that our implementation of mem_sbrk() 
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap. 
- *   
+ *   peak size of the heap plus any mem_map() mappings in bytes while
+ *   running the student's malloc package on the trace. mem_sbrk() lets
+ *   the package give memory back, so the peak is tracked after every
+ *   request rather than read from brk at the end. With -H, the payload,
+ *   heap and mapped sizes are printed HEAP_SAMPLES times over the trace.
  */
 static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 {   
-    int i;
+    int i, j, n;
     int index;
     int size, newsize, oldsize;
     int max_total_size = 0;
     int total_size = 0;
+    size_t heap_size, max_heap_size = 0;
+    int sample = trace->num_ops / HEAP_SAMPLES + 1;
     char *p;
     char *newp, *oldp;
 
     /* initialize the heap and the mm malloc package */
     mem_reset_brk();
-    if (mm_init() < 0)
+    if (alloc->init() < 0)
 	app_error("mm_init failed in eval_mm_util");
 
+    if (heap_report)
+	printf("Heap size for trace %d:\n%8s %10s %10s %10s\n",
+	       tracenum, "op", "payload", "heap", "mapped");
     for (i = 0;  i < trace->num_ops;  i++) {
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_alloc */
+        case CALLOC:
+        case MEMALIGN:
 	    index = trace->ops[i].index;
 	    size = trace->ops[i].size;
 
-	    if ((p = mm_malloc(size)) == NULL) 
+	    if ((p = mm_alloc_op(&trace->ops[i])) == NULL) 
 		app_error("mm_malloc failed in eval_mm_util");
 	    
 	    /* Remember region and size */
@@ -733,13 +1062,29 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 		total_size : max_total_size;
 	    break;
 
+        case BALLOC: /* mm_malloc_batch */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    n = trace->ops[i].arg;
+
+	    if (mm_malloc_batch(size, n, (void **)&trace->blocks[index])
+		!= (size_t)n)
+		app_error("mm_malloc_batch failed in eval_mm_util");
+	    for (j = index; j < index + n; j++)
+		trace->block_sizes[j] = size;
+
+	    total_size += n * size;
+	    max_total_size = (total_size > max_total_size) ?
+		total_size : max_total_size;
+	    break;
+
 	case REALLOC: /* mm_realloc */
 	    index = trace->ops[i].index;
 	    newsize = trace->ops[i].size;
 	    oldsize = trace->block_sizes[index];
 
 	    oldp = trace->blocks[index];
-	    if ((newp = mm_realloc(oldp,newsize)) == NULL)
+	    if ((newp = alloc->realloc(oldp,newsize)) == NULL)
 		app_error("mm_realloc failed in eval_mm_util");
 
 	    /* Remember region and size */
@@ -760,7 +1105,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    size = trace->block_sizes[index];
 	    p = trace->blocks[index];
 	    
-	    mm_free(p);
+	    mm_free_op(&trace->ops[i], p);
 	    
 	    /* Keep track of current total size
 	     * of all allocated blocks */
@@ -768,13 +1113,34 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    
 	    break;
 
+        case BFREE: /* mm_free_batch */
+	    index = trace->ops[i].index;
+	    n = trace->ops[i].arg;
+	    for (j = index; j < index + n; j++)
+		total_size -= trace->block_sizes[j];
+	    mm_free_batch((void **)&trace->blocks[index], n);
+	    break;
+
 	default:
 	    app_error("Nonexistent request type in eval_mm_util");
 
         }
+
+	/* Track the heap high water mark and sample it over time */
+	heap_size = mem_heapsize() + mem_mapsize();
+	if (heap_size > max_heap_size)
+	    max_heap_size = heap_size;
+	if (heap_report && (i % sample == 0 || i == trace->num_ops - 1))
+	    printf("%8d %10d %10lu %10lu\n", i, total_size,
+		   (unsigned long)mem_heapsize(), (unsigned long)mem_mapsize());
+    }
+    if (heap_report && FULL_MM) {
+	mm_trim(0);
+	printf("%8s %10d %10lu %10lu\n", "trim", total_size,
+	       (unsigned long)mem_heapsize(), (unsigned long)mem_mapsize());
     }
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    return ((double)max_total_size / (double)max_heap_size);
 }
 
 
@@ -784,13 +1150,13 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
  */
 static void eval_mm_speed(void *ptr)
 {
-    int i, index, size, newsize;
+    int i, index, newsize, n;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
 
     /* Reset the heap and initialize the mm package */
     mem_reset_brk();
-    if (mm_init() < 0) 
+    if (alloc->init() < 0) 
 	app_error("mm_init failed in eval_mm_speed");
 
     /* Interpret each trace request */
@@ -798,18 +1164,27 @@ static void eval_mm_speed(void *ptr)
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_malloc */
+        case CALLOC:
+        case MEMALIGN:
             index = trace->ops[i].index;
-            size = trace->ops[i].size;
-            if ((p = mm_malloc(size)) == NULL)
+            if ((p = mm_alloc_op(&trace->ops[i])) == NULL)
 		app_error("mm_malloc error in eval_mm_speed");
             trace->blocks[index] = p;
             break;
 
+        case BALLOC: /* mm_malloc_batch */
+            index = trace->ops[i].index;
+            n = trace->ops[i].arg;
+            if (mm_malloc_batch(trace->ops[i].size, n,
+				(void **)&trace->blocks[index]) != (size_t)n)
+		app_error("mm_malloc_batch error in eval_mm_speed");
+            break;
+
 	case REALLOC: /* mm_realloc */
 	    index = trace->ops[i].index;
             newsize = trace->ops[i].size;
 	    oldp = trace->blocks[index];
-            if ((newp = mm_realloc(oldp,newsize)) == NULL)
+            if ((newp = alloc->realloc(oldp,newsize)) == NULL)
 		app_error("mm_realloc error in eval_mm_speed");
             trace->blocks[index] = newp;
             break;
@@ -817,7 +1192,12 @@ static void eval_mm_speed(void *ptr)
         case FREE: /* mm_free */
             index = trace->ops[i].index;
             block = trace->blocks[index];
-            mm_free(block);
+            mm_free_op(&trace->ops[i], block);
+            break;
+
+        case BFREE: /* mm_free_batch */
+            index = trace->ops[i].index;
+            mm_free_batch((void **)&trace->blocks[index], trace->ops[i].arg);
             break;
 
 	default:
@@ -825,6 +1205,265 @@ static void eval_mm_speed(void *ptr)
         }
 }
 
+/*
+ * eval_pages - time the mm package on each trace with the heap backed
+ *    by base pages, transparent huge pages and hugetlb pages, and print
+ *    the speedup over base pages. A kind of page the system can't
+ *    provide is shown as "-".
+ */
+static void eval_pages(char **tracefiles, int num_tracefiles)
+{
+    static char *names[] = {"4KB", "THP", "hugetlb"};
+    double secs[MEM_PAGES_HUGETLB + 1];
+    speed_t speed_params;
+    trace_t *trace;
+    int i, mode;
+
+    printf("Throughput by heap page size (Kops, speedup over 4KB):\n");
+    printf("%5s%10s%10s%7s%10s%7s\n", "trace", names[0], names[1], "",
+	   names[2], "");
+    for (i = 0; i < num_tracefiles; i++) {
+	trace = read_trace(tracedir, tracefiles[i]);
+	speed_params.trace = trace;
+	for (mode = MEM_PAGES_SMALL; mode <= MEM_PAGES_HUGETLB; mode++) {
+	    mem_deinit();
+	    mem_set_pages(mode);
+	    mem_init();
+	    secs[mode] = 0;
+	    if (mem_pages() == mode)
+		secs[mode] = fsecs(eval_mm_speed, &speed_params);
+	}
+	printf("%2d%13.0f", i, (trace->num_ops/1e3)/secs[MEM_PAGES_SMALL]);
+	for (mode = MEM_PAGES_THP; mode <= MEM_PAGES_HUGETLB; mode++) {
+	    if (secs[mode] > 0)
+		printf("%10.0f%6.2fx", (trace->num_ops/1e3)/secs[mode],
+		       secs[MEM_PAGES_SMALL]/secs[mode]);
+	    else
+		printf("%10s%7s", "-", "");
+	}
+	printf("\n");
+	free_trace(trace);
+    }
+    printf("\n");
+
+    /* Put the default heap back */
+    mem_deinit();
+    mem_set_pages(MEM_PAGES_THP);
+    mem_init();
+}
+
+/*
+ * eval_guard - time the mm package on each trace with guard page sampling
+ *    off and at several sample rates, and print the slowdown. Each trace
+ *    is also checked for correctness at the densest rate, where most
+ *    small blocks that fit in the pool come from it.
+ */
+static void eval_guard(char **tracefiles, int num_tracefiles)
+{
+    static int rates[] = {0, 10000, 1000, 100, 10};
+    const int nrates = sizeof(rates) / sizeof(rates[0]);
+    double secs[sizeof(rates) / sizeof(rates[0])];
+    range_t *ranges = NULL;
+    speed_t speed_params;
+    trace_t *trace;
+    int i, r;
+
+    printf("Throughput with 1 in N requests on guard pages (Kops, cost vs. off):\n");
+    printf("%5s%10s", "trace", "off");
+    for (r = 1; r < nrates; r++)
+	printf("%10d%8s", rates[r], "");
+    printf("\n");
+    for (i = 0; i < num_tracefiles; i++) {
+	trace = read_trace(tracedir, tracefiles[i]);
+	speed_params.trace = trace;
+	for (r = 0; r < nrates; r++) {
+	    mm_mallopt(MM_GUARD_SAMPLE, rates[r]);
+	    secs[r] = fsecs(eval_mm_speed, &speed_params);
+	}
+	if (!eval_mm_valid(trace, i, &ranges))
+	    errors++;
+	printf("%2d%13.0f", i, (trace->num_ops/1e3)/secs[0]);
+	for (r = 1; r < nrates; r++)
+	    printf("%10.0f%7.1f%%", (trace->num_ops/1e3)/secs[r],
+		   100.0 * (secs[r] - secs[0]) / secs[0]);
+	printf("\n");
+	free_trace(trace);
+    }
+    printf("\n");
+    clear_ranges(&ranges);
+    mm_mallopt(MM_GUARD_SAMPLE, 0);
+}
+
+/*
+ * eval_heaps - run all the traces at once, one request from each trace
+ *    in turn, with every trace in its own mm_heap_create heap. Payloads
+ *    are filled with the low byte of their id and checked before they
+ *    are freed or reallocated, so a heap that touched another heap's
+ *    blocks shows up as an error.
+ */
+static void eval_heaps(char **tracefiles, int num_tracefiles)
+{
+    heaps_t params;
+    double secs, ops = 0;
+    int i;
+
+    params.n = num_tracefiles;
+    if ((params.traces = (trace_t **)malloc(params.n * sizeof(trace_t *))) == NULL)
+	unix_error("malloc failed in eval_heaps");
+    for (i = 0; i < params.n; i++) {
+	params.traces[i] = read_trace(tracedir, tracefiles[i]);
+	ops += params.traces[i]->num_ops;
+    }
+    params.bad = 0;
+
+    secs = ftimer_gettod(heaps_run, &params, 1);
+    printf("Side by side in %d heaps: %.0f ops in %f secs (%.0f Kops), %s\n\n",
+	   params.n, ops, secs, (ops/1e3)/secs,
+	   params.bad ? "payloads CORRUPTED" : "payloads intact");
+    if (params.bad)
+	errors++;
+
+    for (i = 0; i < params.n; i++)
+	free_trace(params.traces[i]);
+    free(params.traces);
+}
+
+/*
+ * heaps_run - create one heap per trace, interleave the traces' requests,
+ *    and drop each heap whole at the end
+ */
+static void heaps_run(void *ptr)
+{
+    heaps_t *params = (heaps_t *)ptr;
+    mm_heap_t **heaps;
+    int i, k, more;
+
+    if ((heaps = (mm_heap_t **)malloc(params->n * sizeof(mm_heap_t *))) == NULL)
+	unix_error("malloc failed in heaps_run");
+    for (i = 0; i < params->n; i++)
+	if ((heaps[i] = mm_heap_create()) == NULL)
+	    app_error("mm_heap_create failed in heaps_run");
+
+    for (k = 0, more = 1; more; k++) {
+	more = 0;
+	for (i = 0; i < params->n; i++) {
+	    if (k < params->traces[i]->num_ops) {
+		heap_op(heaps[i], params->traces[i], k, &params->bad);
+		more = 1;
+	    }
+	}
+    }
+
+    for (i = 0; i < params->n; i++)
+	mm_heap_destroy(heaps[i]);
+    free(heaps);
+}
+
+/*
+ * heap_op - perform request i of a trace on heap h. Sets *bad if a
+ *    payload was overwritten.
+ */
+static void heap_op(mm_heap_t *h, trace_t *trace, int i, int *bad)
+{
+    traceop_t *op = &trace->ops[i];
+    int index = op->index, size = op->size, j;
+    char *p;
+
+    switch (op->type) {
+    case ALLOC:
+    case CALLOC:
+    case MEMALIGN:
+	if (op->type == CALLOC)
+	    p = mm_heap_calloc(h, op->arg, size / op->arg);
+	else if (op->type == MEMALIGN)
+	    p = mm_heap_memalign(h, op->arg, size);
+	else
+	    p = mm_heap_malloc(h, size);
+	if (p == NULL)
+	    app_error("mm_heap_malloc failed in heap_op");
+	memset(p, index & 0xFF, size);
+	trace->blocks[index] = p;
+	trace->block_sizes[index] = size;
+	break;
+
+    case BALLOC: /* no batch call on a heap instance */
+	for (j = index; j < index + op->arg; j++) {
+	    if ((p = mm_heap_malloc(h, size)) == NULL)
+		app_error("mm_heap_malloc failed in heap_op");
+	    memset(p, j & 0xFF, size);
+	    trace->blocks[j] = p;
+	    trace->block_sizes[j] = size;
+	}
+	break;
+
+    case REALLOC:
+	p = trace->blocks[index];
+	if (p[0] != (char)(index & 0xFF))
+	    *bad = 1;
+	if ((p = mm_heap_realloc(h, p, size)) == NULL)
+	    app_error("mm_heap_realloc failed in heap_op");
+	memset(p, index & 0xFF, size);
+	trace->blocks[index] = p;
+	trace->block_sizes[index] = size;
+	break;
+
+    case FREE:
+    case BFREE:
+	for (j = index; j < index + (op->type == BFREE ? op->arg : 1); j++) {
+	    p = trace->blocks[j];
+	    if (p[0] != (char)(j & 0xFF) ||
+		p[trace->block_sizes[j] - 1] != (char)(j & 0xFF))
+		*bad = 1;
+	    mm_heap_free(h, p);
+	}
+	break;
+    }
+}
+
+/*
+ * mm_alloc_op - perform an ALLOC, CALLOC or MEMALIGN request with mm
+ */
+static char *mm_alloc_op(traceop_t *op)
+{
+    switch (op->type) {
+    case CALLOC:
+	return mm_calloc(op->arg, op->size / op->arg);
+    case MEMALIGN:
+	return mm_memalign(op->arg, op->size);
+    default:
+	return alloc->malloc(op->size);
+    }
+}
+
+/*
+ * mm_free_op - perform a FREE request with mm_free, or with
+ *    mm_free_sized when -S is set and the size is known
+ */
+static void mm_free_op(traceop_t *op, char *p)
+{
+    if (sized_free && FULL_MM && op->arg != 0)
+	mm_free_sized(p, op->arg);
+    else
+	alloc->free(p);
+}
+
+/*
+ * libc_alloc_op - perform an ALLOC, CALLOC or MEMALIGN request with libc
+ */
+static char *libc_alloc_op(traceop_t *op)
+{
+    void *p;
+
+    switch (op->type) {
+    case CALLOC:
+	return calloc(op->arg, op->size / op->arg);
+    case MEMALIGN:
+	return posix_memalign(&p, op->arg, op->size) == 0 ? p : NULL;
+    default:
+	return malloc(op->size);
+    }
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -833,20 +1472,32 @@ static void eval_mm_speed(void *ptr)
  */
 static int eval_libc_valid(trace_t *trace, int tracenum)
 {
-    int i, newsize;
+    int i, j, newsize;
     char *p, *newp, *oldp;
 
     for (i = 0;  i < trace->num_ops;  i++) {
         switch (trace->ops[i].type) {
 
         case ALLOC: /* malloc */
-	    if ((p = malloc(trace->ops[i].size)) == NULL) {
+        case CALLOC:
+        case MEMALIGN:
+	    if ((p = libc_alloc_op(&trace->ops[i])) == NULL) {
 		malloc_error(tracenum, i, "libc malloc failed");
 		unix_error("System message");
 	    }
 	    trace->blocks[trace->ops[i].index] = p;
 	    break;
 
+	case BALLOC: /* no batch call in libc, so malloc one at a time */
+	    for (j = 0; j < trace->ops[i].arg; j++) {
+		if ((p = malloc(trace->ops[i].size)) == NULL) {
+		    malloc_error(tracenum, i, "libc malloc failed");
+		    unix_error("System message");
+		}
+		trace->blocks[trace->ops[i].index + j] = p;
+	    }
+	    break;
+
 	case REALLOC: /* realloc */
             newsize = trace->ops[i].size;
 	    oldp = trace->blocks[trace->ops[i].index];
@@ -861,6 +1512,11 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
 	    free(trace->blocks[trace->ops[i].index]);
 	    break;
 
+	case BFREE: /* free */
+	    for (j = 0; j < trace->ops[i].arg; j++)
+		free(trace->blocks[trace->ops[i].index + j]);
+	    break;
+
 	default:
 	    app_error("invalid operation type  in eval_libc_valid");
 	}
@@ -876,21 +1532,29 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
  */
 static void eval_libc_speed(void *ptr)
 {
-    int i;
-    int index, size, newsize;
+    int i, j;
+    int index, newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
 
     for (i = 0;  i < trace->num_ops;  i++) {
         switch (trace->ops[i].type) {
         case ALLOC: /* malloc */
+        case CALLOC:
+        case MEMALIGN:
 	    index = trace->ops[i].index;
-	    size = trace->ops[i].size;
-	    if ((p = malloc(size)) == NULL)
+	    if ((p = libc_alloc_op(&trace->ops[i])) == NULL)
 		unix_error("malloc failed in eval_libc_speed");
 	    trace->blocks[index] = p;
 	    break;
 
+	case BALLOC: /* malloc */
+	    index = trace->ops[i].index;
+	    for (j = 0; j < trace->ops[i].arg; j++)
+		if ((trace->blocks[index + j] = malloc(trace->ops[i].size)) == NULL)
+		    unix_error("malloc failed in eval_libc_speed");
+	    break;
+
 	case REALLOC: /* realloc */
 	    index = trace->ops[i].index;
 	    newsize = trace->ops[i].size;
@@ -906,10 +1570,138 @@ static void eval_libc_speed(void *ptr)
 	    block = trace->blocks[index];
 	    free(block);
 	    break;
+
+        case BFREE: /* free */
+	    index = trace->ops[i].index;
+	    for (j = 0; j < trace->ops[i].arg; j++)
+		free(trace->blocks[index + j]);
+	    break;
 	}
     }
 }
 
+#ifdef MM_THREAD_SAFE
+/*****************************************************************
+ * The producer/consumer benchmark (-P). Each producer thread
+ * allocates messages and passes them through a ring to its own
+ * consumer thread, which frees them. Throughput is measured for
+ * 1, 2, 4, ... PC_MAXPAIRS pairs with mm and with libc malloc.
+ ****************************************************************/
+
+/*
+ * eval_prodcons - print the throughput table for growing thread counts
+ */
+static void eval_prodcons(void)
+{
+    prodcons_t pc;
+    double ops, mm_secs, libc_secs;
+
+    mem_init();
+    printf("Producer/consumer, %d messages per producer\n", PC_MSGS);
+    printf("%5s%8s%10s%10s\n", "pairs", "threads", "mm Kops", "libc Kops");
+    for (pc.pairs = 1; pc.pairs <= PC_MAXPAIRS; pc.pairs *= 2) {
+	/* one malloc and one free per message */
+	ops = 2.0 * PC_MSGS * pc.pairs;
+
+	mem_reset_brk();
+	if (mm_init() < 0)
+	    app_error("mm_init failed in eval_prodcons");
+	pc.libc = 0;
+	mm_secs = ftimer_gettod(prodcons_run, &pc, 1);
+	pc.libc = 1;
+	libc_secs = ftimer_gettod(prodcons_run, &pc, 1);
+
+	printf("%5d%8d%10.0f%10.0f\n", pc.pairs, 2 * pc.pairs,
+	       (ops/1e3)/mm_secs, (ops/1e3)/libc_secs);
+    }
+}
+
+/*
+ * prodcons_run - start the producer and consumer threads and wait
+ *    for all of them to finish
+ */
+static void prodcons_run(void *ptr)
+{
+    prodcons_t *pc = (prodcons_t *)ptr;
+    pthread_t tid[2 * PC_MAXPAIRS];
+    ring_t *rings;
+    int i;
+
+    if ((rings = (ring_t *)calloc(pc->pairs, sizeof(ring_t))) == NULL)
+	unix_error("calloc failed in prodcons_run");
+    for (i = 0; i < pc->pairs; i++) {
+	rings[i].libc = pc->libc;
+	rings[i].seed = i + 1;
+	if (pthread_create(&tid[2*i], NULL, producer, &rings[i]) != 0 ||
+	    pthread_create(&tid[2*i+1], NULL, consumer, &rings[i]) != 0)
+	    app_error("pthread_create failed in prodcons_run");
+    }
+    for (i = 0; i < 2 * pc->pairs; i++)
+	pthread_join(tid[i], NULL);
+    free(rings);
+}
+
+/*
+ * producer - allocate PC_MSGS messages, mostly small with an occasional
+ *    larger one, and hand them to the consumer
+ */
+static void *producer(void *arg)
+{
+    ring_t *r = (ring_t *)arg;
+    unsigned seed = r->seed;
+    unsigned head;
+    size_t size;
+    char *p;
+    int i;
+
+    for (i = 0; i < PC_MSGS; i++) {
+	if (i % 64)
+	    size = 16 + rand_r(&seed) % 496;
+	else
+	    size = 1024 + rand_r(&seed) % 3072;
+	if ((p = r->libc ? malloc(size) : mm_malloc(size)) == NULL)
+	    app_error("malloc failed in producer");
+	*(int *)p = i;
+
+	/* Wait for a free slot, then publish the message */
+	head = r->head;
+	while (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == PC_RING)
+	    sched_yield();
+	r->slot[head % PC_RING] = p;
+	__atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+/*
+ * consumer - take PC_MSGS messages from the producer, check them,
+ *    and free them
+ */
+static void *consumer(void *arg)
+{
+    ring_t *r = (ring_t *)arg;
+    unsigned tail;
+    char *p;
+    int i;
+
+    for (i = 0; i < PC_MSGS; i++) {
+	tail = r->tail;
+	while (__atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == tail)
+	    sched_yield();
+	p = r->slot[tail % PC_RING];
+	__atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+
+	if (*(int *)p != i)
+	    app_error("consumer got a corrupted message");
+	if (r->libc)
+	    free(p);
+	else
+	    mm_free(p);
+    }
+    return NULL;
+}
+#endif
+
 /*************************************
  * Some miscellaneous helper routines
  ************************************/
@@ -1004,14 +1796,28 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    const mm_allocator_t *a;
+
+    fprintf(stderr, "Usage: mdriver [-hvValHDSPTIG] [-C <n>] [-m <name>] [-s <fmt>] [-f <file>] [-t <dir>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-a         Don't check the team structure.\n");
+    fprintf(stderr, "\t-C <n>     Check the heap on each change: 1 touched blocks, 2 all.\n");
+    fprintf(stderr, "\t-D         Defer coalescing in mm_free (quick lists).\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
+    fprintf(stderr, "\t-G         Compare throughput at several guard page sample rates.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-H         Print heap size over time for each trace.\n");
+    fprintf(stderr, "\t-I         Run all traces side by side in separate heaps.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-m <name>  Evaluate allocator <name>, or every one with -m all:\n");
+    for (a = mm_allocators; a->name != NULL; a++)
+	fprintf(stderr, "\t             %s\n", a->name);
+    fprintf(stderr, "\t-P         Run the producer/consumer benchmark (MM_THREAD_SAFE).\n");
+    fprintf(stderr, "\t-s <fmt>   Print allocator statistics after each trace (text or json).\n");
+    fprintf(stderr, "\t-S         Free with mm_free_sized.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr, "\t-T         Compare throughput on 4KB and huge heap pages.\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
 }
@@ -2,7 +2,17 @@
  * memlib.c - a module that simulates the memory system.  Needed because it 
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
+ *
+ * Each simulated heap is a region (mem_t) with its own brk and its own
+ * list of mappings, so a process can run several independent heaps.
+ * The mem_xxx_r functions take the region explicitly; the original
+ * mem_xxx functions work on the default region set up by mem_init.
+ *
+ * The mem_map bookkeeping comes from pages of its own rather than from
+ * malloc, so the model never calls back into a malloc that mm.c may be
+ * standing in for (libmm.so).
  */
+#define _GNU_SOURCE /* mremap, MAP_HUGETLB */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -10,28 +20,186 @@
 #include <sys/mman.h>
 #include <string.h>
 #include <errno.h>
+#include <stdint.h>
+#ifdef MM_THREAD_SAFE
+#include <pthread.h>
+#endif
 
 #include "memlib.h"
 #include "config.h"
 
+/* The heap is reserved on this boundary so it can be backed by huge pages */
+#define HUGE_PAGE_SIZE (2 * (1 << 20))
+
+/* Records each mapping handed out by mem_map */
+typedef struct map_range {
+    char *addr;
+    size_t size;
+    struct map_range *next;
+} map_range_t;
+
+/* One simulated heap */
+struct mem {
+    char *start_brk;     /* points to first byte of heap */
+    char *brk;           /* points to last byte of heap */
+    char *max_addr;      /* largest legal heap address */ 
+    char *clean_brk;     /* bytes from here up were never handed out */
+    size_t reserved;     /* bytes mapped for the heap */
+    int pages;           /* kind of pages mem_init_r actually got */
+    map_range_t *maps;   /* live mappings */
+    size_t mapped;       /* total bytes in live mappings */
+#ifdef MM_THREAD_SAFE
+    /* serializes brk updates when several threads share the model */
+    pthread_mutex_t lock;
+#endif
+};
+
 /* private variables */
-static char *mem_start_brk;  /* points to first byte of heap */
-static char *mem_brk;        /* points to last byte of heap */
-static char *mem_max_addr;   /* largest legal heap address */ 
+static mem_t mem_default;                  /* the region behind mem_xxx */
+static int mem_pages_want = MEM_PAGES_THP; /* set by mem_set_pages */
+static map_range_t *free_records;          /* unused map_range_t records */
+#ifdef MM_THREAD_SAFE
+static pthread_mutex_t record_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+#ifdef MM_THREAD_SAFE
+#define MEM_LOCK(m) pthread_mutex_lock(&(m)->lock)
+#define MEM_UNLOCK(m) pthread_mutex_unlock(&(m)->lock)
+#else
+#define MEM_LOCK(m)
+#define MEM_UNLOCK(m)
+#endif
+
+/* A NULL region means the default one */
+#define REGION(m) ((m) != NULL ? (m) : &mem_default)
+
+/*
+ * record_alloc - return an unused map_range_t, carving a fresh page
+ *    into records when there are none. Returns NULL if out of memory.
+ */
+static map_range_t *record_alloc(void)
+{
+    map_range_t *r;
+    size_t i, n = mem_pagesize() / sizeof(map_range_t);
+
+#ifdef MM_THREAD_SAFE
+    pthread_mutex_lock(&record_lock);
+#endif
+    if (free_records == NULL) {
+	r = mmap(NULL, mem_pagesize(), PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (r != MAP_FAILED) {
+	    for (i = 0; i < n; i++)
+		r[i].next = i + 1 < n ? &r[i + 1] : NULL;
+	    free_records = r;
+	}
+    }
+    if ((r = free_records) != NULL)
+	free_records = r->next;
+#ifdef MM_THREAD_SAFE
+    pthread_mutex_unlock(&record_lock);
+#endif
+    return r;
+}
+
+/*
+ * record_free - give a record from record_alloc back
+ */
+static void record_free(map_range_t *r)
+{
+#ifdef MM_THREAD_SAFE
+    pthread_mutex_lock(&record_lock);
+#endif
+    r->next = free_records;
+    free_records = r;
+#ifdef MM_THREAD_SAFE
+    pthread_mutex_unlock(&record_lock);
+#endif
+}
+
+/*
+ * mem_reserve - map size bytes of zeroed memory such that addr+off is
+ *    aligned to align bytes (off is a multiple of the page size below
+ *    align), by over-mapping and trimming both ends. flags are added to
+ *    the mmap flags. Returns NULL on failure.
+ */
+static char *mem_reserve(size_t size, size_t align, size_t off, int flags)
+{
+    char *addr, *start;
+    size_t lead;
+
+    if (size > SIZE_MAX - align)
+	return NULL;
+    addr = mmap(NULL, size + align, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+    if (addr == MAP_FAILED)
+	return NULL;
+    start = (char *)(((size_t)addr + off + align - 1) & ~(align - 1)) - off;
+    lead = start - addr;
+    if (lead != 0)
+	munmap(addr, lead);
+    munmap(start + size, align - lead);
+    return start;
+}
+
+/* 
+ * mem_init_r - initialize region m. The heap is an anonymous mapping
+ *    aligned to HUGE_PAGE_SIZE and backed by the kind of pages chosen
+ *    with mem_set_pages. Returns 0, or -1 if there is no memory.
+ */
+static int mem_init_r(mem_t *m)
+{
+    m->reserved = (MAX_HEAP + HUGE_PAGE_SIZE - 1) & ~(size_t)(HUGE_PAGE_SIZE - 1);
+    m->start_brk = NULL;
+    m->pages = MEM_PAGES_SMALL;
+
+#ifdef MAP_HUGETLB
+    /* explicit huge pages need a reserved pool; fall back to THP without one */
+    if (mem_pages_want == MEM_PAGES_HUGETLB) {
+	m->start_brk = mmap(NULL, m->reserved, PROT_READ | PROT_WRITE,
+			    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (m->start_brk == MAP_FAILED)
+	    m->start_brk = NULL;
+	else
+	    m->pages = MEM_PAGES_HUGETLB;
+    }
+#endif
+    if (m->start_brk == NULL) {
+	if ((m->start_brk = mem_reserve(m->reserved, HUGE_PAGE_SIZE, 0,
+					MAP_NORESERVE)) == NULL)
+	    return -1;
+#ifdef MADV_HUGEPAGE
+	if (mem_pages_want != MEM_PAGES_SMALL &&
+	    madvise(m->start_brk, m->reserved, MADV_HUGEPAGE) == 0)
+	    m->pages = MEM_PAGES_THP;
+#endif
+#ifdef MADV_NOHUGEPAGE
+	/* keep base pages even when THP is enabled system-wide */
+	if (mem_pages_want == MEM_PAGES_SMALL)
+	    madvise(m->start_brk, m->reserved, MADV_NOHUGEPAGE);
+#endif
+    }
+
+    m->max_addr = m->start_brk + MAX_HEAP;  /* max legal heap address */
+    m->brk = m->start_brk;                  /* heap is empty initially */
+    m->clean_brk = m->start_brk;            /* and all of it is zero */
+    m->maps = NULL;
+    m->mapped = 0;
+#ifdef MM_THREAD_SAFE
+    pthread_mutex_init(&m->lock, NULL);
+#endif
+    return 0;
+}
 
 /* 
  * mem_init - initialize the memory system model
  */
 void mem_init(void)
 {
-    /* allocate the storage we will use to model the available VM */
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-	fprintf(stderr, "mem_init_vm: malloc error\n");
+    if (mem_init_r(&mem_default) < 0) {
+	fprintf(stderr, "mem_init_vm: mmap error\n");
 	exit(1);
     }
-
-    mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
-    mem_brk = mem_start_brk;                  /* heap is empty initially */
 }
 
 /* 
@@ -39,57 +207,179 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    mem_reset_brk_r(&mem_default);
+    munmap(mem_default.start_brk, mem_default.reserved);
+}
+
+/*
+ * mem_create - make a new region with its own heap and mappings.
+ *    Returns NULL if there is no memory.
+ */
+mem_t *mem_create(void)
+{
+    mem_t *m;
+
+    if ((m = (mem_t *)malloc(sizeof(mem_t))) == NULL)
+	return NULL;
+    if (mem_init_r(m) < 0) {
+	free(m);
+	return NULL;
+    }
+    return m;
+}
+
+/*
+ * mem_destroy - release a region made by mem_create, with its heap
+ *    and every mapping still live in it
+ */
+void mem_destroy(mem_t *m)
+{
+    mem_reset_brk_r(m);
+    munmap(m->start_brk, m->reserved);
+#ifdef MM_THREAD_SAFE
+    pthread_mutex_destroy(&m->lock);
+#endif
+    free(m);
+}
+
+/*
+ * mem_set_pages - choose the pages behind the heap (MEM_PAGES_*) for
+ *    the next mem_init or mem_create
+ */
+void mem_set_pages(int mode)
+{
+    mem_pages_want = mode;
+}
+
+/*
+ * mem_pages - return the kind of pages mem_init actually got, which
+ *    is less than asked for when the system can't provide them
+ */
+int mem_pages(void)
+{
+    return mem_default.pages;
 }
 
 /*
  * mem_reset_brk - reset the simulated brk pointer to make an empty heap
  */
+void mem_reset_brk_r(mem_t *m)
+{
+    map_range_t *r;
+
+    m = REGION(m);
+    m->brk = m->start_brk;
+    /* mappings left over from the previous run are released too */
+    while ((r = m->maps) != NULL) {
+	m->maps = r->next;
+	munmap(r->addr, r->size);
+	record_free(r);
+    }
+    m->mapped = 0;
+}
+
 void mem_reset_brk()
 {
-    mem_brk = mem_start_brk;
+    mem_reset_brk_r(&mem_default);
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    by incr bytes and returns the start address of the new area. A
+ *    negative incr gives the top -incr bytes back and returns the old
+ *    brk, as sbrk does; the heap cannot shrink below its first byte.
+ *    The whole pages released are handed back to the system with
+ *    MADV_DONTNEED, since the heap is one mapping that munmap cannot
+ *    shorten from the top without losing the reservation.
  */
-void *mem_sbrk(int incr) 
+void *mem_sbrk_r(mem_t *m, int incr) 
 {
-    char *old_brk = mem_brk;
+    char *old_brk, *lo, *hi;
+    size_t page;
 
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
+    m = REGION(m);
+    MEM_LOCK(m);
+    old_brk = m->brk;
+    if (((incr < 0) && (m->brk - m->start_brk) < -(long)incr) ||
+	((incr > 0) && (m->max_addr - m->brk) < incr)) {
+	MEM_UNLOCK(m);
 	errno = ENOMEM;
 	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
 	return (void *)-1;
     }
-    mem_brk += incr;
+    m->brk += incr;
+    if (m->brk > m->clean_brk)
+	m->clean_brk = m->brk;
+    if (incr < 0) {
+	/* clean_brk stays at the high-water mark; calloc only clears more */
+	page = m->pages == MEM_PAGES_HUGETLB ? HUGE_PAGE_SIZE : mem_pagesize();
+	lo = (char *)(((size_t)m->brk + page - 1) & ~(page - 1));
+	hi = (char *)(((size_t)old_brk + page - 1) & ~(page - 1));
+	if (lo < hi)
+	    madvise(lo, hi - lo, MADV_DONTNEED);
+    }
+    MEM_UNLOCK(m);
     return (void *)old_brk;
 }
 
+void *mem_sbrk(int incr)
+{
+    return mem_sbrk_r(&mem_default, incr);
+}
+
+/*
+ * mem_heap_clean - return the lowest address above which the heap has
+ *    never been handed out by mem_sbrk since mem_init, so it still
+ *    reads as zero. Memory given back and re-extended does not count.
+ */
+void *mem_heap_clean_r(mem_t *m)
+{
+    return (void *)REGION(m)->clean_brk;
+}
+
+void *mem_heap_clean()
+{
+    return mem_heap_clean_r(&mem_default);
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
+void *mem_heap_lo_r(mem_t *m)
+{
+    return (void *)REGION(m)->start_brk;
+}
+
 void *mem_heap_lo()
 {
-    return (void *)mem_start_brk;
+    return mem_heap_lo_r(&mem_default);
 }
 
 /* 
  * mem_heap_hi - return address of last heap byte
  */
+void *mem_heap_hi_r(mem_t *m)
+{
+    return (void *)(REGION(m)->brk - 1);
+}
+
 void *mem_heap_hi()
 {
-    return (void *)(mem_brk - 1);
+    return mem_heap_hi_r(&mem_default);
 }
 
 /*
  * mem_heapsize() - returns the heap size in bytes
  */
+size_t mem_heapsize_r(mem_t *m)
+{
+    m = REGION(m);
+    return (size_t)(m->brk - m->start_brk);
+}
+
 size_t mem_heapsize() 
 {
-    return (size_t)(mem_brk - mem_start_brk);
+    return mem_heapsize_r(&mem_default);
 }
 
 /*
@@ -99,3 +389,191 @@ size_t mem_pagesize()
 {
     return (size_t)getpagesize();
 }
+
+/*
+ * mem_add_map - record the mapping [addr, addr+size) in region m, or
+ *    unmap it and return NULL if there is no record to spare
+ */
+static void *mem_add_map(mem_t *m, char *addr, size_t size)
+{
+    map_range_t *r;
+
+    if ((r = record_alloc()) == NULL) {
+	munmap(addr, size);
+	return NULL;
+    }
+    r->addr = addr;
+    r->size = size;
+    MEM_LOCK(m);
+    r->next = m->maps;
+    m->maps = r;
+    m->mapped += size;
+    MEM_UNLOCK(m);
+    return addr;
+}
+
+/*
+ * mem_map - model of an anonymous mmap outside the heap. Returns a
+ *    page-aligned mapping of size bytes (rounded up to whole pages),
+ *    or NULL if the system is out of memory.
+ */
+void *mem_map_r(mem_t *m, size_t size)
+{
+    char *addr;
+
+    m = REGION(m);
+    size = (size + mem_pagesize() - 1) & ~(mem_pagesize() - 1);
+    addr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED)
+	return NULL;
+    return mem_add_map(m, addr, size);
+}
+
+/*
+ * mem_map_aligned - like mem_map, but addr+off is a multiple of align
+ *    (a power of 2 above the page size; off is a multiple of the page
+ *    size below align). The slack mapped to find that address is
+ *    unmapped again, so only size bytes stay mapped.
+ */
+void *mem_map_aligned_r(mem_t *m, size_t size, size_t align, size_t off)
+{
+    char *addr;
+
+    m = REGION(m);
+    size = (size + mem_pagesize() - 1) & ~(mem_pagesize() - 1);
+    if ((addr = mem_reserve(size, align, off, 0)) == NULL)
+	return NULL;
+    return mem_add_map(m, addr, size);
+}
+
+void *mem_map(size_t size)
+{
+    return mem_map_r(&mem_default, size);
+}
+
+void *mem_map_aligned(size_t size, size_t align, size_t off)
+{
+    return mem_map_aligned_r(&mem_default, size, align, off);
+}
+
+/*
+ * mem_find_map - return the link that points at the mapping starting
+ *    at addr. The caller holds the region's lock.
+ */
+static map_range_t **mem_find_map(mem_t *m, void *addr)
+{
+    map_range_t **rp;
+
+    for (rp = &m->maps; *rp != NULL; rp = &(*rp)->next)
+	if ((*rp)->addr == addr)
+	    return rp;
+    return NULL;
+}
+
+/*
+ * mem_unmap - release a mapping returned by mem_map
+ */
+void mem_unmap_r(mem_t *m, void *addr)
+{
+    map_range_t **rp, *r = NULL;
+
+    m = REGION(m);
+    MEM_LOCK(m);
+    if ((rp = mem_find_map(m, addr)) != NULL) {
+	r = *rp;
+	*rp = r->next;
+	m->mapped -= r->size;
+    }
+    MEM_UNLOCK(m);
+    if (r == NULL) {
+	fprintf(stderr, "ERROR: mem_unmap of unknown mapping %p\n", addr);
+	return;
+    }
+    munmap(r->addr, r->size);
+    record_free(r);
+}
+
+void mem_unmap(void *addr)
+{
+    mem_unmap_r(&mem_default, addr);
+}
+
+/*
+ * mem_remap - model of mremap. Resizes the mapping at addr to size
+ *    bytes (rounded up to whole pages), moving it if needed. Returns
+ *    the new address, or NULL if the mapping is unchanged.
+ */
+void *mem_remap_r(mem_t *m, void *addr, size_t size)
+{
+    map_range_t **rp;
+    char *naddr = NULL;
+
+    m = REGION(m);
+    size = (size + mem_pagesize() - 1) & ~(mem_pagesize() - 1);
+    MEM_LOCK(m);
+    if ((rp = mem_find_map(m, addr)) != NULL) {
+	naddr = mremap((*rp)->addr, (*rp)->size, size, MREMAP_MAYMOVE);
+	if (naddr == MAP_FAILED)
+	    naddr = NULL;
+	else {
+	    m->mapped += size - (*rp)->size;
+	    (*rp)->addr = naddr;
+	    (*rp)->size = size;
+	}
+    }
+    MEM_UNLOCK(m);
+    return naddr;
+}
+
+void *mem_remap(void *addr, size_t size)
+{
+    return mem_remap_r(&mem_default, addr, size);
+}
+
+/*
+ * mem_is_mapped - returns 1 if [lo, hi] lies inside one live mapping
+ */
+int mem_is_mapped_r(mem_t *m, void *lo, void *hi)
+{
+    map_range_t *r;
+    int found = 0;
+
+    m = REGION(m);
+    MEM_LOCK(m);
+    for (r = m->maps; r != NULL; r = r->next)
+	if ((char *)lo >= r->addr && (char *)hi < r->addr + r->size) {
+	    found = 1;
+	    break;
+	}
+    MEM_UNLOCK(m);
+    return found;
+}
+
+int mem_is_mapped(void *lo, void *hi)
+{
+    return mem_is_mapped_r(&mem_default, lo, hi);
+}
+
+/*
+ * mem_protect - model of mprotect. Makes the pages in [addr, addr+size)
+ *    readable and writable if rw is nonzero, and inaccessible otherwise.
+ *    Returns 0 on success, -1 on error.
+ */
+int mem_protect(void *addr, size_t size, int rw)
+{
+    return mprotect(addr, size, rw ? PROT_READ | PROT_WRITE : PROT_NONE);
+}
+
+/*
+ * mem_mapsize - returns the total size of live mappings in bytes
+ */
+size_t mem_mapsize_r(mem_t *m)
+{
+    return REGION(m)->mapped;
+}
+
+size_t mem_mapsize()
+{
+    return mem_mapsize_r(&mem_default);
+}
@@ -1,11 +1,46 @@
 #include <unistd.h>
 
+/* Pages behind the simulated heap, for mem_set_pages */
+#define MEM_PAGES_SMALL   0 /* base pages only */
+#define MEM_PAGES_THP     1 /* transparent huge pages (madvise), the default */
+#define MEM_PAGES_HUGETLB 2 /* explicit MAP_HUGETLB pages */
+
 void mem_init(void);               
 void mem_deinit(void);
+void mem_set_pages(int mode);
+int mem_pages(void);
 void *mem_sbrk(int incr);
 void mem_reset_brk(void); 
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
+void *mem_heap_clean(void);
 size_t mem_heapsize(void);
 size_t mem_pagesize(void);
+void *mem_map(size_t size);
+void *mem_map_aligned(size_t size, size_t align, size_t off);
+void mem_unmap(void *addr);
+void *mem_remap(void *addr, size_t size);
+int mem_is_mapped(void *lo, void *hi);
+int mem_protect(void *addr, size_t size, int rw);
+size_t mem_mapsize(void);
+
+/* 
+ * Independent regions. Each mem_xxx_r works like mem_xxx on region m;
+ * a NULL m means the default region that mem_init sets up.
+ */
+typedef struct mem mem_t;
 
+mem_t *mem_create(void);
+void mem_destroy(mem_t *m);
+void *mem_sbrk_r(mem_t *m, int incr);
+void mem_reset_brk_r(mem_t *m);
+void *mem_heap_lo_r(mem_t *m);
+void *mem_heap_hi_r(mem_t *m);
+void *mem_heap_clean_r(mem_t *m);
+size_t mem_heapsize_r(mem_t *m);
+void *mem_map_r(mem_t *m, size_t size);
+void *mem_map_aligned_r(mem_t *m, size_t size, size_t align, size_t off);
+void mem_unmap_r(mem_t *m, void *addr);
+void *mem_remap_r(mem_t *m, void *addr, size_t size);
+int mem_is_mapped_r(mem_t *m, void *lo, void *hi);
+size_t mem_mapsize_r(mem_t *m);
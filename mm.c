@@ -1,21 +1,64 @@
 /*
- * mm-naive.c - The fastest, least memory-efficient malloc package.
+ * mm.c - TLSF(two-level segregated fit) 할당기.
  *
- * In this naive approach, a block is allocated by simply incrementing
- * the brk pointer.  A block is pure payload. There are no headers or
- * footers.  Blocks are never coalesced or reused. Realloc is
- * implemented directly using mm_malloc and mm_free.
+ * 가용 블록은 크기에 따라 2단계 구간으로 나뉜 리스트에 들어간다.
+ * 1단계는 2의 거듭제곱 구간, 2단계는 그 구간을 16등분한 것이고,
+ * 두 단계의 비트맵으로 비어 있지 않은 구간을 바로 찾는다. 따라서
+ * mm_malloc과 mm_free는 가용 블록 수와 상관없이 일정한 시간에 끝난다.
+ * TREE_MIN_SIZE 이상의 큰 가용 블록은 (크기, 주소) 순서의 AVL 트리에
+ * 넣고, 가장 작은 것 중 가장 낮은 주소의 블록을 O(log n)에 고른다(best fit).
+ * 블록은 4B 헤더를 가지고, 풋터는 가용 블록에만 둔다. 헤더의 1번 비트에
+ * 이전 블록의 할당 여부를 적어 두므로 할당 블록은 풋터 없이도 이전 블록이
+ * 가용일 때만 그 풋터를 읽어 연결(coalesce)할 수 있다. free 시 즉시 연결한다.
  *
- * NOTE TO STUDENTS: Replace this header comment with your own header
- * comment that gives a high level description of your solution.
+ * SLAB_MAX 이하의 요청은 슬랩에서 준다. 슬랩 런은 RUN_SIZE로 정렬된
+ * 할당 블록 하나를 같은 크기의 칸으로 나눈 것이고, 칸에는 헤더가 없다.
+ * 포인터가 어느 런에 속하는지는 주소를 RUN_SIZE로 내림해서 찾고,
+ * 그 페이지가 런인지는 run_map 비트로 구분한다.
+ *
+ * mm_mallopt(MM_DEFER_COALESCE, 1)로 켜면 QUICK_MAX_SIZE 이하의 블록은 free할 때
+ * 연결하지 않고 크기별 quick 리스트에 할당 상태 그대로 넣어 두었다가 같은 크기
+ * 요청에 바로 돌려준다. 리스트가 넘치거나 힙에서 못 찾으면 한 번에 주소 순으로
+ * 모아서 연결한다(quick_flush).
+ *
+ * MM_THREAD_SAFE로 빌드하면 공유 힙은 락 하나로 보호되고, 작은 블록은
+ * 스레드마다 크기별 캐시(tcache)에 모아 두었다가 락 없이 재사용한다.
+ * 캐시는 공유 힙에서 TCACHE_BATCH개씩 한 번에 채우고 한 번에 돌려주며,
+ * 스레드가 끝나면 남은 블록을 모두 공유 힙에 돌려준다. free할 때 다른 스레드가
+ * 락을 잡고 있으면 기다리지 않고 블록을 lock-free 원격 스택에 CAS로 넣고,
+ * 다음에 락을 잡는 스레드(보통 다음 mm_malloc)가 한꺼번에 돌려준다.
+ *
+ * mmap_threshold 이상의 요청은 힙을 거치지 않고 mem_map으로 따로 매핑하고,
+ * free하면 바로 해제한다. 매핑된 블록은 힙 주소 범위 밖에 있는 것으로 구분한다.
+ *
+ * mm_mallopt(MM_GUARD_SAMPLE, N)으로 켜면 대략 N번에 한 번 요청을 표본으로 뽑아
+ * 따로 매핑한 가드 풀에서 준다. 표본 블록은 데이터 페이지의 끝에 붙여 놓고 바로
+ * 뒤에 PROT_NONE 가드 페이지를 두므로 넘쳐 쓰면 그 자리에서 SIGSEGV가 난다.
+ * free하면 페이지째 막아서 해제 뒤 사용도 잡는다. 표본은 스레드마다 세는
+ * 카운트다운으로 뽑으므로 뽑히지 않은 요청은 감소 하나만 더 한다.
+ *
+ * mm_checkheap은 힙 전체를 프롤로그부터 에필로그까지 훑어 헤더/풋터, 연결,
+ * 가용 리스트와 트리, 슬랩 런을 확인한다. mm_mallopt(MM_CHECK_HEAP, 1)로 켜면
+ * 블록을 나누거나 합친 뒤(place, resize_block, free_block, free_sorted, trim_top,
+ * run_alloc)마다 고친 블록과 그 이웃, 그 리스트 노드만 확인하고 어긋나면 멈춘다.
+ *
+ * 공개 함수는 얇은 껍데기로, 실제 일은 xxx_request가 하고 껍데기는 요청 통계만
+ * 센다(mm_stats). 요청 수와 바이트는 스레드마다 모았다가 STATS_FLUSH번마다 전역
+ * 합계에 더하고, 분할/연결/mem_sbrk 횟수는 락 안에서 힙마다 센다.
  */
 #include "mm.h"
 #include "memlib.h"
+#include "config.h"
 #include <assert.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#ifdef MM_THREAD_SAFE
+#include <pthread.h>
+#endif
 /*********************************************************
  * NOTE TO STUDENTS: Before you do anything else, please
  * provide your team information in the following struct.
@@ -31,30 +74,70 @@ team_t team = {
     "",
     /* Second member's email address (leave blank if none) */
     ""};
-/* 주소를 워드(4)로 정렬할지 더블 워드(8)로 정렬 할지 결정한다 */
-#define ALIGNMENT 8
-/* 받은 주소가 워드의 배수가 되도록 만든다 */
-#define ALIGN(size) (((size) + (ALIGNMENT - 1)) & ~0x7)
-#define SIZE_T_SIZE (ALIGN(sizeof(size_t)))
-/*
- * mm_init - initialize the malloc package.
- */
+/* 정렬 단위(ALIGNMENT)는 config.h에서 8 또는 16으로 고른다 */
+#if ALIGNMENT != 8 && ALIGNMENT != 16
+#error "ALIGNMENT must be 8 or 16"
+#endif
+/* 받은 크기가 정렬 단위의 배수가 되도록 올린다 */
+#define ALIGN(size) (((size) + (ALIGNMENT - 1)) & ~(size_t)(ALIGNMENT - 1))
 /* 기본적인 상수와 매크로*/
-#define WSIZE 4             //워드의 크기
+/* 헤더/풋터는 64비트에서도 4B다. 힙은 MAX_HEAP을 넘지 않으므로 크기는 32비트에 들어간다 */
+#define WSIZE 4             //워드(헤더/풋터)의 크기
 #define DSIZE 8             //더블워드의 크기
+#define PSIZE sizeof(void *) //포인터의 크기
+/* 가용 리스트 링크는 기본으로 heap_base로부터의 32비트 오프셋이다 (MM_PTR_LINKS면 포인터) */
+#ifdef MM_PTR_LINKS
+#define LSIZE PSIZE
+#else
+#define LSIZE WSIZE
+#endif
+/* 가장 작은 블록: 헤더 + 링크 두 개 + 풋터를 정렬 단위로 올린 것 (오프셋이면 64비트에서도 16B) */
+#define MIN_BLOCK ALIGN(2 * WSIZE + 2 * LSIZE)
 #define CHUNKSIZE (1 << 12) //힙 영역을 한 번 늘릴 때 마다 늘려 줄 크기
+#define TRIM_THRESHOLD (128 * 1024) //free 뒤 꼭대기 가용 블록이 이만큼 되면 힙을 줄인다
+#define TRIM_PAD (32 * 1024)        //자동으로 줄일 때 꼭대기에 남겨 두는 크기
+#define MMAP_THRESHOLD (256 * 1024)          //이 크기 이상의 요청은 따로 매핑한다 (초기값)
+#define MMAP_THRESHOLD_MIN (64 * 1024)       //임계값이 저절로 내려갈 수 있는 한도
+#define MMAP_THRESHOLD_MAX (16 * 1024 * 1024) //mm_mallopt로 정할 수 있는 한도
+#define GUARD_SLOTS 64        //가드 풀의 기본 칸 수 (칸마다 데이터 페이지 하나와 가드 페이지 하나)
+#define GUARD_SLOTS_MAX 4096  //mm_mallopt로 정할 수 있는 칸 수의 한도
+#define GUARD_IDLE (1 << 16)  //표본을 끈 동안 카운트다운이 설정을 다시 보는 간격
+#define GUARD_FILL 0xAB       //표본 블록 끝의 정렬 여유 바이트에 채워 두는 값
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
-/* 크기와 할당 상태를 1워드로 묶는다 */
-#define PACK(size, alloc) ((size) | (alloc))
+/* 주소 p를 2의 거듭제곱 a의 배수로 올린다 */
+#define ALIGN_UP(p, a) ((char *)(((uintptr_t)(p) + (a) - 1) & ~(uintptr_t)((a) - 1)))
+/* 크기를 페이지 단위로 올린다 (매핑 크기) */
+#define ALIGN_PAGE(size) (((size) + mem_pagesize() - 1) & ~(mem_pagesize() - 1))
+/* 크기, 이전 블록의 할당 상태, 할당 상태를 1워드로 묶는다 */
+#define PACK(size, prev_alloc, alloc) ((size) | ((prev_alloc) << 1) | (alloc))
 /* 주소 p에 있는 값을 읽고 쓴다 */
 #define GET(p) (*(unsigned int *)(p))
 #define PUT(p, val) (*(unsigned int *)(p) = (val))
 /* 주소 p에서 블록의 크기와 할당상태를 읽어온다 */
 #define GET_SIZE(p) (GET(p) & ~0x7)
 #define GET_ALLOC(p) (GET(p) & 0x1)
+#define GET_PREV_ALLOC(p) ((GET(p) >> 1) & 0x1)
+/* 블록 bp 헤더의 이전 블록 할당 비트를 켜고 끈다.
+   GET_BLK_SIZE는 락 없이 자기 블록의 크기를 읽을 때 쓴다 */
+#ifdef MM_THREAD_SAFE
+/* 할당 블록의 주인은 락 없이 자기 헤더를 읽고, 이웃은 락 안에서 그 헤더의 1번 비트를 바꾼다 */
+#define SET_PREV_ALLOC(bp) __atomic_fetch_or((unsigned int *)HDRP(bp), 0x2, __ATOMIC_RELAXED)
+#define CLR_PREV_ALLOC(bp) __atomic_fetch_and((unsigned int *)HDRP(bp), ~0x2, __ATOMIC_RELAXED)
+#define GET_BLK_SIZE(bp) (__atomic_load_n((unsigned int *)HDRP(bp), __ATOMIC_RELAXED) & ~0x7)
+/* 락 없이 읽는 mm_mallopt 값 */
+#define LOAD_OPT(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define STORE_OPT(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+#else
+#define LOAD_OPT(x) (x)
+#define STORE_OPT(x, v) ((x) = (v))
+#define SET_PREV_ALLOC(bp) (GET(HDRP(bp)) |= 0x2)
+#define CLR_PREV_ALLOC(bp) (GET(HDRP(bp)) &= ~0x2)
+#define GET_BLK_SIZE(bp) GET_SIZE(HDRP(bp))
+#endif
 /* 블록 포인터 bp를 받으면, 그 블록의 헤더와 풋터 주소를 반환한다 */
 #define HDRP(bp) ((char *)(bp)-WSIZE)
 /* 포인터가 배열[0]을 가리키고 있을 것이기 때문에 1워드만큼 앞으로 가면 헤더가 나온다 */
+/* 풋터는 가용 블록에만 있다 */
 #define FTRP(bp) ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
 /* 포인터를 헤더로 옮겨서 사이즈를 가져온 다음, 포인터부터 시작해서 사이즈만큼 뒤로 간다,
     그리고 헤더와 풋터를 제외한만큼(2워드)앞으로 간다 */
@@ -62,195 +145,2253 @@ team_t team = {
 #define NEXT_BLKP(bp) ((char *)(bp) + GET_SIZE(((char *)(bp)-WSIZE)))
 /* 현재 블록의 헤더로 가서 사이즈 값을 받아 그 만큼 뒤로 간다 -> 다음 블록 시작으로 간다 */
 #define PREV_BLKP(bp) ((char *)(bp)-GET_SIZE(((char *)(bp)-DSIZE)))
-/* 이전 블록의 풋터로 간 다음 사이즈 값을 받아 이전 블록의 시작으로 간다 */
-#define PRED_P(bp) (*(void **)(bp))
-#define SUCC_P(bp) (*(void **)((bp) + WSIZE))
-static void *heap_listp;
+/* 이전 블록의 풋터로 간 다음 사이즈 값을 받아 이전 블록의 시작으로 간다 (이전 블록이 가용일 때만) */
+/* 매핑된 블록: payload 바로 앞에 매핑 시작에서 payload까지의 거리와 매핑 크기를 둔다 */
+#define MAP_HDR_SIZE ALIGN(2 * sizeof(size_t))
+#define MAP_OFF(bp) (((size_t *)(bp))[-2])
+#define MAP_SIZE(bp) (((size_t *)(bp))[-1])
+#define MAP_BASE(bp) ((char *)(bp) - MAP_OFF(bp))
+#define IS_MAPPED(bp) ((uintptr_t)(bp) - (uintptr_t)heap->base >= MAX_HEAP)
+#ifdef MM_PTR_LINKS
+#define GET_PRED(bp) (*(void **)(bp))
+#define GET_SUCC(bp) (*(void **)((char *)(bp) + PSIZE))
+#define SET_PRED(bp, p) (GET_PRED(bp) = (p))
+#define SET_SUCC(bp, p) (GET_SUCC(bp) = (p))
+#else
+/* 오프셋 0은 패딩 워드라 블록이 될 수 없으므로 NULL로 쓴다 */
+#define TO_OFF(p) ((p) ? (unsigned int)((char *)(p) - heap->base) : 0)
+#define TO_PTR(off) ((off) ? (void *)(heap->base + (off)) : NULL)
+#define GET_PRED(bp) TO_PTR(GET(bp))
+#define GET_SUCC(bp) TO_PTR(GET((char *)(bp) + WSIZE))
+#define SET_PRED(bp, p) PUT(bp, TO_OFF(p))
+#define SET_SUCC(bp, p) PUT((char *)(bp) + WSIZE, TO_OFF(p))
+#endif
+/* 가용 블록 안의 이전/다음 가용 블록 링크 */
+
+/* TLSF 인덱스 상수 */
+#define SL_INDEX_COUNT_LOG2 4 // 2단계: 1단계 구간 하나를 2^4 = 16개로 나눈다
+#define SL_INDEX_COUNT (1 << SL_INDEX_COUNT_LOG2)
+#define ALIGN_SIZE_LOG2 3 // 블록 크기는 항상 8의 배수
+#define FL_INDEX_SHIFT (SL_INDEX_COUNT_LOG2 + ALIGN_SIZE_LOG2)
+#define FL_INDEX_MAX 10 // 2^10 바이트 미만의 블록까지 다루고, 그 이상은 트리로 간다
+#define FL_INDEX_COUNT (FL_INDEX_MAX - FL_INDEX_SHIFT + 1)
+#define SMALL_BLOCK_SIZE (1 << FL_INDEX_SHIFT) // 128B 미만은 1단계 0번 안에서 8B 간격으로 나눈다
+#define TREE_MIN_SIZE (1 << FL_INDEX_MAX)
+/* 가장 높은/낮은 1 비트의 위치 */
+#define FLS(x) (31 - __builtin_clz((unsigned int)(x)))
+#define FFS(x) (__builtin_ctz(x))
+
+/* mm_mallopt로 바꿀 수 있는 값. mmap 임계값은 큰 블록이 free되며 힙 가운데에
+   구멍을 남길 때마다 그 크기로 내려간다. 직접 정하면 더 이상 저절로 바뀌지 않는다 */
+static size_t mmap_threshold = MMAP_THRESHOLD;
+static size_t trim_threshold = TRIM_THRESHOLD;
+static size_t top_pad = TRIM_PAD;
+static int mmap_dynamic = 1;
+static int check_level; // MM_CHECK_HEAP: 0 끔, 1 고친 블록만, 2 힙 전체
+static int stats_on;    // MM_STATS: 0이면 요청 수와 바이트를 세지 않는다
+
+/* 요청 통계. 내준 바이트와 돌려받은 바이트를 따로 세고 그 차이가 살아 있는 바이트다 */
+#define STATS_FLUSH 64 // 스레드별 카운터를 이만큼 센 뒤 전역 합계에 더한다
+typedef struct {
+    size_t alloc_bytes; // 내준 블록의 mm_usable_size 합
+    size_t freed_bytes;
+    unsigned long mallocs, frees, reallocs;
+    unsigned int pending; // 아직 더하지 않은 연산 수 (MM_THREAD_SAFE)
+} stat_counts_t;
+static stat_counts_t stat_total;
+static size_t stat_peak;
+#if FL_INDEX_COUNT * SL_INDEX_COUNT + 1 != MM_STATS_BINS
+#error "MM_STATS_BINS must match the TLSF lists plus the tree"
+#endif
+
+/*
+ * 가드 풀: [가드][데이터][가드][데이터]...[가드] 페이지를 한 번에 매핑한 것.
+ * 빈 칸은 free된 순서대로(FIFO) 다시 쓰므로 방금 free한 칸은 가장 늦게 돌아온다.
+ * 풀은 기본 memlib 영역의 매핑이라 mem_reset_brk와 함께 사라지고, 첫 표본 때 다시 만든다.
+ */
+static unsigned int guard_rate;                 // 약 guard_rate번에 한 번 표본 (0이면 끔)
+static unsigned int guard_slots = GUARD_SLOTS;  // 다음에 만들 풀의 칸 수
+static char *guard_pool;                        // 풀의 시작, 아직 없으면 NULL
+static size_t guard_pool_size;
+static unsigned int guard_nslots;
+static size_t *guard_req;                       // 칸별 요청 크기, 0이면 빈 칸
+static unsigned int *guard_ring;                // 빈 칸 번호의 원형 큐
+static unsigned int guard_head, guard_avail;
+#define GUARD_PAGE(i) (guard_pool + (2 * (size_t)(i) + 1) * mem_pagesize())
+#ifdef MM_THREAD_SAFE
+/* 카운트다운은 스레드마다 센다. 1에서 시작하므로 첫 요청에 guard_rate를 읽는다 */
+static __thread unsigned long sample_left = 1;
+static __thread unsigned int sample_seed;
+static pthread_mutex_t guard_lock = PTHREAD_MUTEX_INITIALIZER;
+#define GUARD_LOCK() pthread_mutex_lock(&guard_lock)
+#define GUARD_UNLOCK() pthread_mutex_unlock(&guard_lock)
+/* 풀 포인터는 락 없이 읽으므로 다른 필드를 채운 뒤 release로 내놓는다 */
+#define LOAD_POOL() __atomic_load_n(&guard_pool, __ATOMIC_ACQUIRE)
+#define STORE_POOL(p) __atomic_store_n(&guard_pool, (p), __ATOMIC_RELEASE)
+#else
+static unsigned long sample_left = 1;
+static unsigned int sample_seed;
+#define GUARD_LOCK()
+#define GUARD_UNLOCK()
+#define LOAD_POOL() guard_pool
+#define STORE_POOL(p) (guard_pool = (p))
+#endif
+
+/* 큰 가용 블록 트리의 노드: 왼쪽/오른쪽 자식과 높이를 payload에 둔다 */
+#define T_LEFT(bp) (*(void **)(bp))
+#define T_RIGHT(bp) (*(void **)((char *)(bp) + PSIZE))
+#define T_HEIGHT(bp) (*(int *)((char *)(bp) + 2 * PSIZE))
+/* (크기, 주소) 순서로 a가 b보다 앞인가 */
+#define T_LESS(a, b) (GET_SIZE(HDRP(a)) < GET_SIZE(HDRP(b)) || \
+                      (GET_SIZE(HDRP(a)) == GET_SIZE(HDRP(b)) && (char *)(a) < (char *)(b)))
+static void *tree_search(size_t size, void *after);
 static void *coalesce(void *bp);
-static void *extend_heap(size_t words);
+static void *extend_heap(size_t size);
 static void *find_fit(size_t asize);
 static void place(void *p, size_t size);
 static void list_add(void *p);
 static void list_remove(void *p);
+static void mapping_insert(size_t size, int *fli, int *sli);
+static void mapping_search(size_t size, int *fli, int *sli);
+static void *malloc_block(size_t asize);
+static void free_block(void *bp);
+static void free_locked(void *bp);
+static int trim_top(size_t pad);
+static void *map_malloc(size_t size, size_t align);
+static void *guard_sample(size_t size);
+static int guard_pool_init(void);
+static int is_guarded(void *bp);
+static void guard_free(void *bp);
+static void *guard_realloc(void *bp, size_t size);
+static void *memalign_block(size_t asize, size_t align);
+static void map_free(void *bp);
+static void resize_block(void *bp, size_t total, size_t asize);
+static int quick_push(void *bp);
+static void *quick_pop(size_t asize);
+static void quick_flush(void);
+static void free_sorted(void **v, size_t n);
+static int batch_blocks(size_t asize, size_t n, void **out);
+static void check_op(void *bp);
+static void *malloc_request(size_t size);
+static void free_request(void *ptr);
+static void *realloc_request(void *ptr, size_t size);
+static void *calloc_request(size_t nmemb, size_t size);
+static void *memalign_request(size_t align, size_t size);
+static void stat_alloc(size_t n);
+static void stat_free(size_t n);
+static void stat_tick(void);
+static size_t stat_batch(void **out, size_t n);
+static void stat_flush(void);
+static int check_full(int verbose);
+static int check_local(void *bp);
+static int check_block(void *bp);
+/* 블록을 고친 뒤에 부른다. bp가 NULL이면 꼭대기 블록을 통째로 돌려준 것이다 */
+#define CHECK_BLOCK(bp)                 \
+    do {                                \
+        if (LOAD_OPT(check_level))      \
+            check_op(bp);               \
+    } while (0)
+/* 요청 통계 훅. MM_STATS를 켰을 때만 블록 크기를 읽는다 (mm_free_sized의 지름길을 살린다) */
+#define STAT_ALLOC(bp)                              \
+    do {                                            \
+        if (LOAD_OPT(stats_on))                     \
+            stat_alloc(mm_usable_size(bp));         \
+    } while (0)
+#define STAT_FREE(bp)                               \
+    do {                                            \
+        if (LOAD_OPT(stats_on))                     \
+            stat_free(mm_usable_size(bp));          \
+    } while (0)
+
+/* 슬랩 상수 */
+#define SLAB_MAX 256     // 이 크기 이하의 요청은 슬랩에서 준다
+#if ALIGNMENT == 8
+#define SLAB_CLASSES 16 // 8, 16, ..., 64, 80, ..., 128, 160, ..., 256
+#else
+#define SLAB_CLASSES 12 // 16, 32, ..., 128, 160, ..., 256
+#endif
+#define RUN_SHIFT 12
+#define RUN_SIZE (1 << RUN_SHIFT) // 런 하나의 크기, 런의 시작 주소는 RUN_SIZE의 배수
+#define RUN_BLOCK_SIZE (RUN_SIZE + ALIGNMENT) // 런을 담는 할당 블록 (헤더 + RUN_SIZE를 정렬)
+#define RUN_HDR_SIZE ALIGN(sizeof(run_t))
+#define RUN_SCAN 8 // 돌려받은 런 자리를 찾을 때 살펴볼 최대 블록 수
+/* 칸 포인터로 런 헤더를 찾는다 */
+#define SLAB_RUN(p) ((run_t *)((uintptr_t)(p) & ~(uintptr_t)(RUN_SIZE - 1)))
+/* 빈 칸은 첫 워드로 다음 빈 칸을 잇는다 */
+#define SLOT_NEXT(p) (*(void **)(p))
+/* run_map: 힙의 RUN_SIZE 페이지마다 1바이트, 런이면 1 (락 없이 읽으므로 비트로 묶지 않는다) */
+#define RUN_PAGE(p) (((uintptr_t)(p) - ((uintptr_t)heap->base & ~(uintptr_t)(RUN_SIZE - 1))) >> RUN_SHIFT)
+#define RUN_MAP_SIZE (MAX_HEAP / RUN_SIZE + 2)
+
+typedef struct run {
+    struct run *prev; // 같은 크기 클래스에서 빈 칸이 있는 런끼리 잇는다
+    struct run *next;
+    void *free;            // 반납된 칸의 리스트
+    unsigned short size;   // 칸 크기
+    unsigned short nslots; // 런 안의 칸 수
+    unsigned short bump;   // 한 번도 나가지 않은 첫 칸의 번호
+    unsigned short used;   // 사용 중인 칸 수
+    unsigned int cls;
+} run_t;
+
+#if ALIGNMENT == 8
+static const unsigned short slab_sizes[SLAB_CLASSES] = {8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256};
+/* (size + 7) / 8 -> 크기 클래스 */
+static const unsigned char slab_class_of[SLAB_MAX / ALIGNMENT + 1] = {
+    0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 8, 9, 9, 10, 10, 11, 11,
+    12, 12, 12, 12, 13, 13, 13, 13, 14, 14, 14, 14, 15, 15, 15, 15};
+#else
+static const unsigned short slab_sizes[SLAB_CLASSES] = {16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256};
+/* (size + 15) / 16 -> 크기 클래스 */
+static const unsigned char slab_class_of[SLAB_MAX / ALIGNMENT + 1] = {
+    0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 8, 9, 9, 10, 10, 11, 11};
+#endif
+#define SLAB_CLASS(size) (slab_class_of[((size) + ALIGNMENT - 1) / ALIGNMENT])
+static void *slab_malloc(int cls);
+static void slab_free(void *p);
+static int is_slab(void *p);
+static void run_unlink(run_t *r);
+
+/* quick 리스트 상수 (지연 연결) */
+#define QUICK_MAX_SIZE 4096 // 이 크기 이하의 블록만 quick 리스트에 넣는다
+#define QUICK_LIMIT 16      // 크기 하나에 쌓아 둘 최대 블록 수
+#define QUICK_TOTAL 256     // 모든 quick 리스트에 쌓아 둘 최대 블록 수
+/* quick 리스트의 블록은 할당 상태 그대로 두고, 첫 워드로 다음 것을 잇는다 */
+#define QUICK_NEXT(bp) (*(void **)(bp))
+static int defer_coalesce;
+
+#ifdef MM_THREAD_SAFE
+/* 공유 힙(인덱스, listp, mem_sbrk)은 힙마다 있는 락 하나로 보호한다 */
+#define HEAP_LOCK() heap_lock_acquire()
+#define HEAP_TRYLOCK() heap_lock_try()
+#define HEAP_UNLOCK() pthread_mutex_unlock(&heap->lock)
+
+/*
+ * 원격 free 스택: 락이 잡혀 있을 때 free된 블록을 할당 상태 그대로 쌓아 두는
+ * lock-free 스택. 여러 스레드가 CAS로 넣고(사슬째 넣을 수 있다), 다음에 락을
+ * 잡는 스레드가 exchange 한 번으로 통째로 꺼내 돌려준다.
+ */
+#define REMOTE_NEXT(bp) (*(void **)(bp))
+static void heap_lock_acquire(void);
+static int heap_lock_try(void);
+static void remote_push(void *first, void *last);
+static void remote_drain(void);
+
+/* 스레드 캐시 상수 */
+#define TCACHE_MAX_SIZE 512 // 이 크기 이하의 블록만 캐시한다
+/* 앞쪽 SLAB_CLASSES개는 슬랩 칸, 그 뒤는 블록 크기 MIN_BLOCK부터 ALIGNMENT 간격 */
+#define TCACHE_CLASSES (SLAB_CLASSES + (TCACHE_MAX_SIZE - MIN_BLOCK) / ALIGNMENT + 1)
+#define TCACHE_IDX(size) (SLAB_CLASSES + ((size) - MIN_BLOCK) / ALIGNMENT)
+#define TCACHE_MAX 16  // 크기별로 들고 있을 최대 블록 수
+#define TCACHE_BATCH 8 // 공유 힙과 한 번에 주고받는 블록 수
+/* 캐시에 든 블록과 칸은 할당 상태 그대로 두고, 첫 워드로 다음 것을 잇는다 */
+#define TC_NEXT(bp) (*(void **)(bp))
+#define TCACHED(asize) ((asize) <= TCACHE_MAX_SIZE && TCACHE_ON()) // 스레드 캐시를 거치는 블록인가
+
+typedef struct {
+    void *head[TCACHE_CLASSES];
+    unsigned int count[TCACHE_CLASSES];
+    unsigned int gen; // 캐시를 채운 힙의 세대 (mm_init마다 바뀐다)
+} tcache_t;
+
+static __thread tcache_t tcache;
+static unsigned int heap_gen;
+static pthread_key_t tcache_key;
+static pthread_once_t tcache_once = PTHREAD_ONCE_INIT;
+static void tcache_check(void);
+static void *tcache_get(int c, size_t asize);
+static int tcache_class(void *bp);
+static int tcache_put(void *bp, int c);
+#define TCACHE_ON() (heap == &main_heap) // 스레드 캐시는 기본 힙의 블록만 담는다
+#else
+#define HEAP_LOCK()
+#define HEAP_TRYLOCK() 1
+#define HEAP_UNLOCK()
+#define TCACHED(asize) 0
+#endif
+
+/*
+ * 힙 하나의 상태. 힙마다 memlib 영역이 따로 있으므로 메타데이터를 나눠 쓰지 않는다.
+ * mm_init, mm_malloc 등은 기본 힙(main_heap)을 쓰고, mm_heap_xxx는 heap을 잠시
+ * 넘겨받은 힙으로 바꿔서 같은 코드를 탄다.
+ */
+struct mm_heap {
+    mem_t *mem;  // 이 힙의 memlib 영역, NULL이면 기본 영역
+    char *listp; // 프롤로그 블록
+    char *base;  // mem_heap_lo(), 가용 리스트 오프셋의 기준
+    /* free_lists[fl][sl]: 크기 구간별 가용 리스트의 첫 블록 */
+    void *free_lists[FL_INDEX_COUNT][SL_INDEX_COUNT];
+    /* fl_bitmap의 i번 비트: sl_bitmap[i]가 0이 아님, sl_bitmap[i]의 j번 비트: free_lists[i][j]가 비어 있지 않음 */
+    unsigned int fl_bitmap;
+    unsigned int sl_bitmap[FL_INDEX_COUNT];
+    void *tree_root;
+    /* slab_partial[c]: 빈 칸이 있는 c 클래스 런의 리스트 */
+    run_t *slab_partial[SLAB_CLASSES];
+    unsigned char run_map[RUN_MAP_SIZE];
+    void *quick_lists[QUICK_MAX_SIZE / ALIGNMENT + 1];
+    unsigned short quick_count[QUICK_MAX_SIZE / ALIGNMENT + 1];
+    unsigned int quick_total;
+    void *quick_buf[QUICK_TOTAL + 1]; // quick_flush에서 주소 순으로 정렬할 자리
+    unsigned long splits, coalesces, sbrks; // mm_stats용, 락 안에서 센다
+#ifdef MM_THREAD_SAFE
+    pthread_mutex_t lock;
+    void *remote_head; // 원격 free 스택
+#endif
+};
+
+#ifdef MM_THREAD_SAFE
+static __thread stat_counts_t stat_local; // 이 스레드가 아직 더하지 않은 카운터
+#define STAT (&stat_local)
+#else
+#define STAT (&stat_total)
+#endif
 
+#ifdef MM_THREAD_SAFE
+static mm_heap_t main_heap = {.lock = PTHREAD_MUTEX_INITIALIZER};
+static __thread mm_heap_t *heap = &main_heap; // 이 스레드가 지금 다루는 힙
+#else
+static mm_heap_t main_heap;
+static mm_heap_t *heap = &main_heap;
+#endif
+static int heap_init(void);
+
+/*
+ * mm_init - 기본 힙을 비우고 다시 놓는다. mdriver는 트레이스마다 mm_init을 다시 부른다.
+ */
 int mm_init(void) {
-    if ((heap_listp = mem_sbrk(6 * WSIZE)) == (void *)-1)
+    /* 저절로 내려간 임계값도 힙과 함께 처음으로 돌린다 */
+    if (mmap_dynamic)
+        mmap_threshold = MMAP_THRESHOLD;
+#ifdef MM_THREAD_SAFE
+    /* 이전 힙을 가리키는 캐시와 원격 스택은 버린다 */
+    heap_gen++;
+    __atomic_store_n(&main_heap.remote_head, NULL, __ATOMIC_RELAXED);
+#endif
+    /* 가드 풀은 보통 mem_reset_brk와 함께 이미 해제됐다. 다음 표본 때 새로 만든다 */
+    if (guard_pool != NULL) {
+        if (mem_is_mapped(guard_pool, guard_pool))
+            mem_unmap(guard_pool);
+        if (mem_is_mapped(guard_req, guard_req))
+            mem_unmap(guard_req);
+        STORE_POOL(NULL);
+    }
+    memset(&stat_total, 0, sizeof(stat_total));
+    memset(STAT, 0, sizeof(stat_counts_t));
+    stat_peak = 0;
+    heap = &main_heap;
+    return heap_init();
+}
+
+/*
+ * heap_init - 현재 힙에 패딩, 프롤로그 헤더/풋터, 에필로그 헤더를 놓고 인덱스를 비운다.
+ *     mem_heap_lo()가 16B 정렬이면 첫 블록의 payload(4 * WSIZE)는 ALIGNMENT 8, 16 모두에 맞는다.
+ */
+static int heap_init(void) {
+    if ((heap->listp = mem_sbrk_r(heap->mem, 4 * WSIZE)) == (void *)-1)
         return -1;
-    PUT(heap_listp, 0);
-    PUT(heap_listp + (1 * WSIZE), PACK(2 * DSIZE, 1));
-    PUT(heap_listp + (2 * WSIZE), heap_listp + (3 * WSIZE));
-    PUT(heap_listp + (3 * WSIZE), heap_listp + (2 * WSIZE));
-    PUT(heap_listp + (4 * WSIZE), PACK(2 * DSIZE, 1));
-    PUT(heap_listp + (5 * WSIZE), PACK(0, 1));
-    heap_listp += 2 * WSIZE;
-    if (extend_heap(CHUNKSIZE / WSIZE) == NULL)
+    PUT(heap->listp, 0);
+    PUT(heap->listp + (1 * WSIZE), PACK(DSIZE, 1, 1));
+    PUT(heap->listp + (2 * WSIZE), PACK(DSIZE, 1, 1));
+    PUT(heap->listp + (3 * WSIZE), PACK(0, 1, 1));
+    heap->base = mem_heap_lo_r(heap->mem);
+    heap->listp += 2 * WSIZE;
+    memset(heap->free_lists, 0, sizeof(heap->free_lists));
+    memset(heap->sl_bitmap, 0, sizeof(heap->sl_bitmap));
+    heap->fl_bitmap = 0;
+    heap->tree_root = NULL;
+    memset(heap->slab_partial, 0, sizeof(heap->slab_partial));
+    memset(heap->run_map, 0, sizeof(heap->run_map));
+    memset(heap->quick_lists, 0, sizeof(heap->quick_lists));
+    memset(heap->quick_count, 0, sizeof(heap->quick_count));
+    heap->quick_total = 0;
+    heap->splits = heap->coalesces = 0;
+    heap->sbrks = 1;
+    if (extend_heap(CHUNKSIZE) == NULL)
         return -1;
     return 0;
 }
 
-static void *extend_heap(size_t words) {
+/*
+ * mm_heap_create - 자기 memlib 영역을 가진 새 힙을 만든다. 메모리가 없으면 NULL.
+ *     이 힙의 블록은 mm_heap_xxx로만 다루고, mm_heap_destroy로 한 번에 버린다.
+ */
+mm_heap_t *mm_heap_create(void) {
+    mm_heap_t *h, *prev = heap;
+    int ret;
+
+    if ((h = malloc(sizeof(mm_heap_t))) == NULL)
+        return NULL;
+    if ((h->mem = mem_create()) == NULL) {
+        free(h);
+        return NULL;
+    }
+#ifdef MM_THREAD_SAFE
+    pthread_mutex_init(&h->lock, NULL);
+    h->remote_head = NULL;
+#endif
+    heap = h;
+    ret = heap_init();
+    heap = prev;
+    if (ret < 0) {
+        mm_heap_destroy(h);
+        return NULL;
+    }
+    return h;
+}
+
+/* 힙과 그 안의 블록, 매핑을 모두 한 번에 돌려준다 */
+void mm_heap_destroy(mm_heap_t *h) {
+    mem_destroy(h->mem);
+#ifdef MM_THREAD_SAFE
+    pthread_mutex_destroy(&h->lock);
+#endif
+    free(h);
+}
+
+/* h를 현재 힙으로 삼아 expr를 계산하고 원래 힙으로 돌린다 */
+#define ON_HEAP(h, expr)           \
+    do {                           \
+        mm_heap_t *prev_ = heap;   \
+        heap = (h);                \
+        expr;                      \
+        heap = prev_;              \
+    } while (0)
+
+void *mm_heap_malloc(mm_heap_t *h, size_t size) {
+    void *p;
+    ON_HEAP(h, p = mm_malloc(size));
+    return p;
+}
+
+void *mm_heap_calloc(mm_heap_t *h, size_t nmemb, size_t size) {
+    void *p;
+    ON_HEAP(h, p = mm_calloc(nmemb, size));
+    return p;
+}
+
+void *mm_heap_memalign(mm_heap_t *h, size_t align, size_t size) {
+    void *p;
+    ON_HEAP(h, p = mm_memalign(align, size));
+    return p;
+}
+
+void *mm_heap_realloc(mm_heap_t *h, void *ptr, size_t size) {
+    void *p;
+    ON_HEAP(h, p = mm_realloc(ptr, size));
+    return p;
+}
+
+void mm_heap_free(mm_heap_t *h, void *ptr) {
+    ON_HEAP(h, mm_free(ptr));
+}
+
+/*
+ * extend_heap - 힙을 size 바이트(정렬 단위로 올림)만큼 늘리고 새 가용 블록을 연결한다.
+ *     mem_sbrk의 int 인자나 32비트 헤더에 들어가지 않는 크기는 늘리지 않고 NULL이다.
+ */
+static void *extend_heap(size_t size) {
     char *bp;
-    size_t size;
-    size = (words % 2) ? (words + 1) * WSIZE : words * WSIZE;
-    if ((long)(bp = mem_sbrk(size)) == -1)
+    if (size > MAX_HEAP || size > (size_t)INT_MAX - ALIGNMENT)
+        return NULL;
+    size = ALIGN(size);
+    if ((bp = mem_sbrk_r(heap->mem, size)) == (void *)-1)
         return NULL;
+    heap->sbrks++;
 
-    PUT(HDRP(bp), PACK(size, 0));
-    PUT(FTRP(bp), PACK(size, 0));
-    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));
+    /* 옛 에필로그 헤더가 새 블록의 헤더가 되므로 이전 블록 할당 비트를 물려받는다 */
+    PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp)), 0));
+    PUT(FTRP(bp), PACK(size, 0, 0));
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 0, 1));
     return coalesce(bp);
 }
 /*
- * mm_malloc - Allocate a block by incrementing the brk pointer.
- *     Always allocate a block whose size is a multiple of the alignment.
+ * mm_malloc - TLSF 인덱스에서 요청 크기 이상이 보장되는 구간의 첫 블록을 꺼낸다.
+ *     없으면 힙을 늘린다.
  */
 void *mm_malloc(size_t size) {
+    void *bp = malloc_request(size);
+    if (bp != NULL)
+        STAT_ALLOC(bp);
+    return bp;
+}
+
+/* malloc_request - 통계를 세지 않는 mm_malloc. 다른 요청이 안에서 부른다 */
+static void *malloc_request(size_t size) {
     size_t asize;
-    size_t extendsize;
     char *bp;
     if (size == 0)
         return NULL;
-    if (size <= DSIZE)
-        asize = 2 * DSIZE;
-    else
-        asize = DSIZE * ((size + (DSIZE) + (DSIZE - 1)) / DSIZE);
+    if (--sample_left == 0 && (bp = guard_sample(size)) != NULL)
+        return bp;
+    if (size >= LOAD_OPT(mmap_threshold))
+        return map_malloc(size, ALIGNMENT);
+    if (size <= SLAB_MAX) {
+#ifdef MM_THREAD_SAFE
+        if (TCACHE_ON())
+            return tcache_get(SLAB_CLASS(size), 0);
+#endif
+        HEAP_LOCK();
+        bp = slab_malloc(SLAB_CLASS(size));
+        HEAP_UNLOCK();
+        return bp;
+    }
+    /* 할당 블록에는 헤더만 붙는다 */
+    asize = MAX(ALIGN(size + WSIZE), MIN_BLOCK);
 
+#ifdef MM_THREAD_SAFE
+    if (asize <= TCACHE_MAX_SIZE && TCACHE_ON())
+        return tcache_get(TCACHE_IDX(asize), asize);
+#endif
+    HEAP_LOCK();
+    bp = malloc_block(asize);
+    HEAP_UNLOCK();
+    return bp;
+}
+
+/* 공유 힙에서 asize 크기의 블록을 잡는다. 락은 부르는 쪽이 잡는다 */
+static void *malloc_block(size_t asize) {
+    size_t extendsize;
+    char *bp;
+    if (heap->quick_total && (bp = quick_pop(asize)) != NULL)
+        return bp;
     if ((bp = find_fit(asize)) != NULL) {
         place(bp, asize);
         return bp;
     }
+    /* 못 찾으면 미뤄 둔 블록을 연결해 보고 나서 힙을 늘린다 */
+    if (heap->quick_total) {
+        quick_flush();
+        if ((bp = find_fit(asize)) != NULL) {
+            place(bp, asize);
+            return bp;
+        }
+    }
     extendsize = MAX(asize, CHUNKSIZE);
-    if ((bp = extend_heap(extendsize / WSIZE)) == NULL)
+    if ((bp = extend_heap(extendsize)) == NULL)
         return NULL;
     place(bp, asize);
     return bp;
 }
+
+/* 크기가 속한 (fl, sl) 구간을 구한다 */
+static void mapping_insert(size_t size, int *fli, int *sli) {
+    int fl, sl;
+    if (size < SMALL_BLOCK_SIZE) {
+        fl = 0;
+        sl = size / (SMALL_BLOCK_SIZE / SL_INDEX_COUNT);
+    } else {
+        fl = FLS(size);
+        sl = (size >> (fl - SL_INDEX_COUNT_LOG2)) ^ SL_INDEX_COUNT;
+        fl -= FL_INDEX_SHIFT - 1;
+    }
+    *fli = fl;
+    *sli = sl;
+}
+
+/* 크기를 다음 구간 경계로 올려서, 찾은 구간의 어떤 블록이든 size 이상이 되게 한다 */
+static void mapping_search(size_t size, int *fli, int *sli) {
+    if (size >= SMALL_BLOCK_SIZE)
+        size += (1 << (FLS(size) - SL_INDEX_COUNT_LOG2)) - 1;
+    mapping_insert(size, fli, sli);
+}
+
+/*
+ * find_fit - 작은 요청은 비트맵으로 비어 있지 않은 구간을 바로 찾는다 (O(1)).
+ *     TLSF 구간에 없거나 큰 요청이면 트리에서 best fit을 찾는다 (O(log n)).
+ */
 static void *find_fit(size_t asize) {
-    void *ptr;
-    for (ptr = SUCC_P(heap_listp); !GET_ALLOC(HDRP(ptr)); ptr = SUCC_P(ptr)) {
-        if (asize <= GET_SIZE(HDRP(ptr))) {
-            return ptr;
+    int fl, sl;
+    unsigned int sl_map, fl_map;
+    if (asize < TREE_MIN_SIZE) {
+        mapping_search(asize, &fl, &sl);
+        if (fl < FL_INDEX_COUNT) {
+            sl_map = heap->sl_bitmap[fl] & (~0U << sl);
+            if (!sl_map) {
+                /* 같은 1단계 안에 없으면 더 큰 1단계에서 찾는다 */
+                fl_map = (fl + 1 < FL_INDEX_COUNT) ? heap->fl_bitmap & (~0U << (fl + 1)) : 0;
+                if (fl_map)
+                    sl_map = heap->sl_bitmap[fl = FFS(fl_map)];
+            }
+            if (sl_map)
+                return heap->free_lists[fl][FFS(sl_map)];
         }
     }
-    return NULL;
+    return tree_search(asize, NULL);
 }
 static void place(void *p, size_t size) {
     size_t free_block = GET_SIZE(HDRP(p));
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(p));
     list_remove(p);
-    if ((free_block - size) >= (2 * DSIZE)) {
-        PUT(HDRP(p), PACK(size, 1));
-        PUT(FTRP(p), PACK(size, 1));
+    if ((free_block - size) >= MIN_BLOCK) {
+        heap->splits++;
+        PUT(HDRP(p), PACK(size, prev_alloc, 1));
         p = NEXT_BLKP(p);
-        PUT(HDRP(p), PACK(free_block - size, 0));
-        PUT(FTRP(p), PACK(free_block - size, 0));
+        PUT(HDRP(p), PACK(free_block - size, 1, 0));
+        PUT(FTRP(p), PACK(free_block - size, 0, 0));
         list_add(p);
     } else {
-        PUT(HDRP(p), PACK(free_block, 1));
-        PUT(FTRP(p), PACK(free_block, 1));
+        PUT(HDRP(p), PACK(free_block, prev_alloc, 1));
+        SET_PREV_ALLOC(NEXT_BLKP(p));
     }
+    CHECK_BLOCK(p);
+}
+
+/* 트리 노드의 높이 */
+static int t_height(void *n) {
+    return n ? T_HEIGHT(n) : 0;
+}
+
+static void t_update(void *n) {
+    int l = t_height(T_LEFT(n)), r = t_height(T_RIGHT(n));
+    T_HEIGHT(n) = (l > r ? l : r) + 1;
 }
 
+static void *t_rotate_right(void *n) {
+    void *l = T_LEFT(n);
+    T_LEFT(n) = T_RIGHT(l);
+    T_RIGHT(l) = n;
+    t_update(n);
+    t_update(l);
+    return l;
+}
+
+static void *t_rotate_left(void *n) {
+    void *r = T_RIGHT(n);
+    T_RIGHT(n) = T_LEFT(r);
+    T_LEFT(r) = n;
+    t_update(n);
+    t_update(r);
+    return r;
+}
+
+/* 양쪽 높이 차가 2가 되면 회전해서 1 이하로 맞춘다 */
+static void *t_balance(void *n) {
+    int diff;
+    t_update(n);
+    diff = t_height(T_LEFT(n)) - t_height(T_RIGHT(n));
+    if (diff > 1) {
+        if (t_height(T_LEFT(T_LEFT(n))) < t_height(T_RIGHT(T_LEFT(n))))
+            T_LEFT(n) = t_rotate_left(T_LEFT(n));
+        return t_rotate_right(n);
+    }
+    if (diff < -1) {
+        if (t_height(T_RIGHT(T_RIGHT(n))) < t_height(T_LEFT(T_RIGHT(n))))
+            T_RIGHT(n) = t_rotate_right(T_RIGHT(n));
+        return t_rotate_left(n);
+    }
+    return n;
+}
+
+static void *t_insert(void *n, void *bp) {
+    if (n == NULL) {
+        T_LEFT(bp) = NULL;
+        T_RIGHT(bp) = NULL;
+        T_HEIGHT(bp) = 1;
+        return bp;
+    }
+    if (T_LESS(bp, n))
+        T_LEFT(n) = t_insert(T_LEFT(n), bp);
+    else
+        T_RIGHT(n) = t_insert(T_RIGHT(n), bp);
+    return t_balance(n);
+}
+
+/* 가장 앞 노드를 떼어 낸 서브트리를 돌려준다. 뗀 노드는 *min에 */
+static void *t_remove_min(void *n, void **min) {
+    if (T_LEFT(n) == NULL) {
+        *min = n;
+        return T_RIGHT(n);
+    }
+    T_LEFT(n) = t_remove_min(T_LEFT(n), min);
+    return t_balance(n);
+}
+
+static void *t_remove(void *n, void *bp) {
+    void *m;
+    if (n == bp) {
+        if (T_RIGHT(n) == NULL)
+            return T_LEFT(n);
+        T_RIGHT(n) = t_remove_min(T_RIGHT(n), &m);
+        T_LEFT(m) = T_LEFT(n);
+        T_RIGHT(m) = T_RIGHT(n);
+        return t_balance(m);
+    }
+    if (T_LESS(bp, n))
+        T_LEFT(n) = t_remove(T_LEFT(n), bp);
+    else
+        T_RIGHT(n) = t_remove(T_RIGHT(n), bp);
+    return t_balance(n);
+}
+
+/* (크기, 주소) 순서로 (size, after)보다 뒤인 첫 블록. after가 NULL이면 size 이상인 첫 블록 */
+static void *tree_search(size_t size, void *after) {
+    void *n = heap->tree_root, *best = NULL;
+    size_t nsize;
+    while (n != NULL) {
+        nsize = GET_SIZE(HDRP(n));
+        if (nsize > size || (nsize == size && (char *)n > (char *)after)) {
+            best = n;
+            n = T_LEFT(n);
+        } else {
+            n = T_RIGHT(n);
+        }
+    }
+    return best;
+}
+
+/* 헤더의 크기로 구간을 정해 그 리스트 맨 앞에 넣는다 (LIFO). 큰 블록은 트리에 넣는다 */
 static void list_add(void *p) {
-    SUCC_P(p) = SUCC_P(heap_listp);
-    PRED_P(p) = heap_listp;
-    PRED_P(SUCC_P(heap_listp)) = p;
-    SUCC_P(heap_listp) = p;
+    int fl, sl;
+    if (GET_SIZE(HDRP(p)) >= TREE_MIN_SIZE) {
+        heap->tree_root = t_insert(heap->tree_root, p);
+        return;
+    }
+    mapping_insert(GET_SIZE(HDRP(p)), &fl, &sl);
+    SET_PRED(p, NULL);
+    SET_SUCC(p, heap->free_lists[fl][sl]);
+    if (heap->free_lists[fl][sl] != NULL)
+        SET_PRED(heap->free_lists[fl][sl], p);
+    heap->free_lists[fl][sl] = p;
+    heap->fl_bitmap |= 1U << fl;
+    heap->sl_bitmap[fl] |= 1U << sl;
 }
 
+/* 헤더 크기를 바꾸기 전에 불러야 한다. 리스트가 비면 비트맵도 지운다 */
 static void list_remove(void *p) {
-    SUCC_P(PRED_P(p)) = SUCC_P(p);
-    PRED_P(SUCC_P(p)) = PRED_P(p);
+    int fl, sl;
+    void *pred, *succ;
+    if (GET_SIZE(HDRP(p)) >= TREE_MIN_SIZE) {
+        heap->tree_root = t_remove(heap->tree_root, p);
+        return;
+    }
+    mapping_insert(GET_SIZE(HDRP(p)), &fl, &sl);
+    pred = GET_PRED(p);
+    succ = GET_SUCC(p);
+    if (pred != NULL)
+        SET_SUCC(pred, succ);
+    else
+        heap->free_lists[fl][sl] = succ;
+    if (succ != NULL)
+        SET_PRED(succ, pred);
+    if (heap->free_lists[fl][sl] == NULL) {
+        heap->sl_bitmap[fl] &= ~(1U << sl);
+        if (!heap->sl_bitmap[fl])
+            heap->fl_bitmap &= ~(1U << fl);
+    }
 }
 /*
- * mm_free - Freeing a block does nothing.
+ * mm_free - 블록을 가용으로 표시하고 인접 가용 블록과 합친다.
  */
 void mm_free(void *ptr) {
-    size_t size = GET_SIZE(HDRP(ptr));
-    PUT(HDRP(ptr), PACK(size, 0));
-    PUT(FTRP(ptr), PACK(size, 0));
-    coalesce(ptr);
+    if (ptr == NULL)
+        return;
+    STAT_FREE(ptr);
+    free_request(ptr);
+}
+
+/* free_request - 통계를 세지 않는 mm_free */
+static void free_request(void *ptr) {
+    if (IS_MAPPED(ptr)) {
+        map_free(ptr);
+        return;
+    }
+#ifdef MM_THREAD_SAFE
+    if (TCACHE_ON() && tcache_put(ptr, tcache_class(ptr)))
+        return;
+    /* 다른 스레드가 힙을 쓰고 있으면 기다리지 않고 원격 스택에 넣는다 */
+    if (!HEAP_TRYLOCK()) {
+        remote_push(ptr, ptr);
+        return;
+    }
+#else
+    HEAP_LOCK();
+#endif
+    free_locked(ptr);
+    HEAP_UNLOCK();
+}
+
+/* 슬랩 칸이면 런에, 아니면 힙에 돌려준다. 락은 부르는 쪽이 잡는다 */
+static void free_locked(void *bp) {
+    if (is_slab(bp))
+        slab_free(bp);
+    else if (!defer_coalesce || !quick_push(bp))
+        free_block(bp);
+}
+
+/*
+ * mm_free_sized - 블록 크기를 아는 호출자용 free. size는 할당할 때 요청한 크기 이상,
+ *     mm_usable_size 이하여야 한다. SLAB_MAX 이하면 슬랩 칸이고 클래스도 크기로
+ *     정해지므로 run_map이나 런 헤더를 읽지 않는다. 힙 블록은 어차피 헤더를 고쳐
+ *     써야 하므로 mm_free와 같다. mm_memalign으로 받은 블록에는 쓸 수 없다.
+ *     MM_DEBUG로 빌드하면 size가 블록과 맞는지 확인한다.
+ */
+void mm_free_sized(void *ptr, size_t size) {
+    if (ptr == NULL)
+        return;
+#ifdef MM_DEBUG
+    if (size > mm_usable_size(ptr) || (size != 0 && size <= SLAB_MAX && !IS_MAPPED(ptr) && !is_slab(ptr))) {
+        fprintf(stderr, "mm_free_sized: size %lu does not match block %p\n", (unsigned long)size, ptr);
+        abort();
+    }
+#endif
+    if (size == 0 || size > SLAB_MAX || IS_MAPPED(ptr)) {
+        mm_free(ptr);
+        return;
+    }
+    // 칸 안에서 줄인 블록이면 실제 칸보다 작게 셀 수 있다 (런 헤더를 읽지 않으려고)
+    if (LOAD_OPT(stats_on))
+        stat_free(slab_sizes[SLAB_CLASS(size)]);
+#ifdef MM_THREAD_SAFE
+    /* 칸 안에서 줄인 realloc 뒤에는 크기로 구한 클래스가 실제 칸보다 작을 수 있다.
+       그 클래스 요청에 더 큰 칸을 주게 될 뿐이라 그대로 캐시에 넣는다 */
+    if (TCACHE_ON() && tcache_put(ptr, SLAB_CLASS(size)))
+        return;
+#endif
+    HEAP_LOCK();
+    slab_free(ptr);
+    HEAP_UNLOCK();
+}
+
+/* ptr 블록에서 실제로 쓸 수 있는 바이트 수 (malloc_usable_size) */
+size_t mm_usable_size(void *ptr) {
+    if (ptr == NULL)
+        return 0;
+    if (IS_MAPPED(ptr)) {
+        if (is_guarded(ptr))
+            return GUARD_PAGE(((char *)ptr - guard_pool) / (2 * mem_pagesize())) + mem_pagesize() - (char *)ptr;
+        return MAP_SIZE(ptr) - MAP_OFF(ptr);
+    }
+    if (is_slab(ptr))
+        return SLAB_RUN(ptr)->size;
+    return GET_BLK_SIZE(ptr) - WSIZE;
+}
+
+/* 공유 힙에 블록을 돌려준다. 락은 부르는 쪽이 잡는다 */
+static void free_block(void *bp) {
+    size_t size = GET_SIZE(HDRP(bp));
+    PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp)), 0));
+    PUT(FTRP(bp), PACK(size, 0, 0));
+    bp = coalesce(bp);
+    CHECK_BLOCK(bp);
+    if (GET_SIZE(HDRP(NEXT_BLKP(bp))) == 0) {
+        /* 합쳐진 블록이 힙 꼭대기에 있고 충분히 크면 힙을 돌려준다 */
+        if (GET_SIZE(HDRP(bp)) >= trim_threshold)
+            trim_top(top_pad);
+    } else if (mmap_dynamic && size >= MMAP_THRESHOLD_MIN + MIN_BLOCK + 2 * ALIGNMENT) {
+        /* 큰 블록이 힙 가운데에 구멍을 남겼다. 이 크기의 요청은 앞으로 따로 매핑한다.
+           블록 크기에서 분할 여유를 빼서 이 블록을 받았던 요청보다 작게 맞춘다 */
+        size -= MIN_BLOCK + 2 * ALIGNMENT;
+        if (size < mmap_threshold)
+            STORE_OPT(mmap_threshold, size);
+    }
+}
+/*
+ * trim_top - 에필로그 바로 앞의 가용 블록에서 pad만 남기고 CHUNKSIZE 단위로
+ *     mem_sbrk에 돌려준다. 돌려준 게 있으면 1을 반환한다. 락은 부르는 쪽이 잡는다.
+ */
+static int trim_top(size_t pad) {
+    char *epilogue = (char *)mem_heap_hi_r(heap->mem) + 1 - WSIZE;
+    char *bp;
+    size_t size, keep, release;
+
+    if (GET_PREV_ALLOC(epilogue))
+        return 0;
+    size = GET_SIZE(epilogue - WSIZE); // 꼭대기 가용 블록의 풋터
+    bp = epilogue + WSIZE - size;
+    keep = pad ? MAX(ALIGN(pad), MIN_BLOCK) : 0;
+    if (size <= keep)
+        return 0;
+    release = (size - keep) & ~(size_t)(CHUNKSIZE - 1);
+    // 남는 조각이 블록이 되기에 작으면 한 단위 덜 돌려준다
+    if (size - release != 0 && size - release < MIN_BLOCK)
+        release = release > CHUNKSIZE ? release - CHUNKSIZE : 0;
+    if (release == 0)
+        return 0;
+
+    list_remove(bp);
+    if (size == release) {
+        // 블록 전체를 돌려주면 그 헤더 자리가 새 에필로그가 된다 (앞 블록은 할당 상태)
+        PUT(HDRP(bp), PACK(0, 1, 1));
+    } else {
+        PUT(HDRP(bp), PACK(size - release, 1, 0));
+        PUT(FTRP(bp), PACK(size - release, 0, 0));
+        PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 0, 1));
+        list_add(bp);
+    }
+    mem_sbrk_r(heap->mem, -(int)release);
+    heap->sbrks++;
+    CHECK_BLOCK(size == release ? NULL : bp);
+    return 1;
+}
+
+/*
+ * map_malloc - 힙을 거치지 않고 size 바이트를 따로 매핑한다. 매핑은 페이지 정렬이므로
+ *     align이 페이지보다 크면 첫 페이지(매핑 헤더 자리) 다음이 align에 맞는 매핑을 받는다.
+ *     정렬 여유는 mem_map_aligned가 도로 해제하므로 매핑은 align과 상관없이 size 남짓이다.
+ */
+static void *map_malloc(size_t size, size_t align) {
+    char *base, *p;
+    size_t page = mem_pagesize(), len = size + MAP_HDR_SIZE + align - ALIGNMENT;
+    if (size > (size_t)PTRDIFF_MAX - MAP_HDR_SIZE - align - page) // len과 페이지 올림이 넘치지 않게
+        return NULL;
+    if (align > page) {
+        len = page + size;
+        if ((base = mem_map_aligned_r(heap->mem, len, align, page)) == NULL)
+            return NULL;
+        p = base + page;
+    } else {
+        if ((base = mem_map_r(heap->mem, len)) == NULL)
+            return NULL;
+        p = ALIGN_UP(base + MAP_HDR_SIZE, align);
+    }
+    MAP_OFF(p) = p - base;
+    MAP_SIZE(p) = ALIGN_PAGE(len);
+    return p;
+}
+
+/* 매핑을 통째로 해제한다. 가용 리스트는 건드리지 않는다. 가드 풀도 힙 밖이라 여기로 온다 */
+static void map_free(void *bp) {
+    if (is_guarded(bp)) {
+        guard_free(bp);
+        return;
+    }
+    mem_unmap_r(heap->mem, MAP_BASE(bp));
+}
+
+/*
+ * guard_sample - 카운트다운이 0이 된 요청을 처리한다. 다음 카운트다운을 [1, 2N-1]에서
+ *     고르고(평균 N), 한 페이지에 들어가는 요청이면 가드 풀의 빈 칸에서 준다.
+ *     payload는 데이터 페이지 끝에 붙인다. 못 주면 NULL이고 보통 경로로 간다.
+ */
+static void *guard_sample(size_t size) {
+    unsigned int rate = LOAD_OPT(guard_rate), i;
+    size_t page = mem_pagesize();
+    char *p;
+
+    if (rate == 0) {
+        sample_left = GUARD_IDLE;
+        return NULL;
+    }
+    if (sample_seed == 0)
+        sample_seed = (unsigned int)(uintptr_t)&sample_left | 1;
+    sample_seed ^= sample_seed << 13; // xorshift32
+    sample_seed ^= sample_seed >> 17;
+    sample_seed ^= sample_seed << 5;
+    sample_left = 1 + sample_seed % (2 * rate - 1);
+    if (ALIGN(size) > page)
+        return NULL;
+
+    GUARD_LOCK();
+    if ((guard_pool == NULL && guard_pool_init() < 0) || guard_avail == 0) {
+        GUARD_UNLOCK(); // 풀이 다 찼으면 이번 표본은 건너뛴다
+        return NULL;
+    }
+    i = guard_ring[guard_head];
+    guard_head = (guard_head + 1) % guard_nslots;
+    guard_avail--;
+    guard_req[i] = size;
+    mem_protect(GUARD_PAGE(i), page, 1);
+    GUARD_UNLOCK();
+
+    // 정렬 때문에 끝에 남는 바이트는 채워 두었다가 free할 때 확인한다
+    p = GUARD_PAGE(i) + page - ALIGN(size);
+    memset(p + size, GUARD_FILL, ALIGN(size) - size);
+    return p;
+}
+
+/* guard_slots칸짜리 풀을 매핑하고 전부 막는다. 락은 부르는 쪽이 잡는다 */
+static int guard_pool_init(void) {
+    unsigned int n = guard_slots, i;
+    size_t size = (2 * (size_t)n + 1) * mem_pagesize();
+    char *pool;
+
+    if ((pool = mem_map(size)) == NULL)
+        return -1;
+    // 표를 libc malloc에서 얻으면 libmm.so에서는 이 할당기로 되돌아오므로 따로 매핑한다
+    if ((guard_req = mem_map(n * (sizeof(size_t) + sizeof(unsigned int)))) == NULL ||
+        mem_protect(pool, size, 0) < 0) {
+        if (guard_req != NULL)
+            mem_unmap(guard_req);
+        mem_unmap(pool);
+        return -1;
+    }
+    guard_ring = (unsigned int *)(guard_req + n);
+    for (i = 0; i < n; i++)
+        guard_ring[i] = i;
+    guard_head = 0;
+    guard_avail = guard_nslots = n;
+    guard_pool_size = size;
+    STORE_POOL(pool);
+    return 0;
+}
+
+/* bp가 가드 풀 안에 있는가. 매핑된 블록을 다룰 때만 부른다 */
+static int is_guarded(void *bp) {
+    char *pool = LOAD_POOL();
+    return pool != NULL && (uintptr_t)((char *)bp - pool) < guard_pool_size;
+}
+
+/* 표본 칸을 막고 빈 칸 큐의 뒤에 넣는다. 이중 free, 잘못된 포인터, 정렬 여유에 넘친 쓰기는 멈춘다 */
+static void guard_free(void *bp) {
+    size_t page = mem_pagesize(), size;
+    unsigned int i = ((char *)bp - guard_pool) / (2 * page);
+    char *p, *end = GUARD_PAGE(i) + page;
+    const char *what = NULL;
+
+    GUARD_LOCK();
+    size = guard_req[i];
+    if (size == 0)
+        what = "double free";
+    else if ((char *)bp != end - ALIGN(size))
+        what = "invalid free";
+    else
+        for (p = (char *)bp + size; p < end; p++)
+            if (*(unsigned char *)p != GUARD_FILL)
+                what = "heap overflow";
+    if (what != NULL) {
+        fprintf(stderr, "mm: %s of sampled block %p\n", what, bp);
+        abort();
+    }
+    mem_protect(GUARD_PAGE(i), page, 0);
+    guard_req[i] = 0;
+    guard_ring[(guard_head + guard_avail) % guard_nslots] = i;
+    guard_avail++;
+    GUARD_UNLOCK();
+}
+
+/* 표본 블록은 제자리에서 늘리지 않고 옮긴다. 새 블록도 표본일 수 있다 */
+static void *guard_realloc(void *bp, size_t size) {
+    size_t old = guard_req[((char *)bp - guard_pool) / (2 * mem_pagesize())];
+    void *newptr;
+
+    if ((newptr = malloc_request(size)) == NULL)
+        return NULL;
+    memcpy(newptr, bp, old < size ? old : size);
+    guard_free(bp);
+    return newptr;
+}
+
+/*
+ * mm_mallopt - 임계값을 바꾼다 (mallopt). 성공하면 1, 잘못된 값이면 0을 반환한다.
+ *     하나라도 직접 정하면 mmap 임계값은 더 이상 저절로 바뀌지 않는다.
+ */
+int mm_mallopt(int param, int value) {
+    if (value < 0)
+        return 0;
+    HEAP_LOCK();
+    switch (param) {
+    case MM_DEFER_COALESCE:
+        defer_coalesce = value != 0;
+        if (!defer_coalesce && heap->quick_total)
+            quick_flush();
+        HEAP_UNLOCK();
+        return 1;
+    case MM_STATS:
+        STORE_OPT(stats_on, value != 0);
+        HEAP_UNLOCK();
+        return 1;
+    case MM_CHECK_HEAP:
+        if (value > 2) {
+            HEAP_UNLOCK();
+            return 0;
+        }
+        STORE_OPT(check_level, value);
+        HEAP_UNLOCK();
+        return 1;
+    case MM_GUARD_SAMPLE:
+        STORE_OPT(guard_rate, value);
+        sample_left = 1; // 다른 스레드는 다음 표본이나 GUARD_IDLE번 뒤에 읽는다
+        HEAP_UNLOCK();
+        return 1;
+    case MM_GUARD_SLOTS:
+        // 풀이 이미 있으면 다음 mm_init 뒤에 새로 만들 때부터 쓴다
+        if (value == 0 || value > GUARD_SLOTS_MAX) {
+            HEAP_UNLOCK();
+            return 0;
+        }
+        guard_slots = value;
+        HEAP_UNLOCK();
+        return 1;
+    case MM_MMAP_THRESHOLD:
+        if ((size_t)value <= SLAB_MAX || (size_t)value > MMAP_THRESHOLD_MAX) {
+            HEAP_UNLOCK();
+            return 0;
+        }
+        STORE_OPT(mmap_threshold, value);
+        break;
+    case MM_TRIM_THRESHOLD:
+        trim_threshold = value;
+        break;
+    case MM_TOP_PAD:
+        top_pad = value;
+        break;
+    default:
+        HEAP_UNLOCK();
+        return 0;
+    }
+    mmap_dynamic = 0;
+    HEAP_UNLOCK();
+    return 1;
+}
+
+/*
+ * mm_trim - 힙 꼭대기의 가용 메모리를 pad 바이트만 남기고 돌려준다 (malloc_trim).
+ *     실제로 줄었으면 1, 아니면 0을 반환한다.
+ */
+int mm_trim(size_t pad) {
+    int ret, c;
+    run_t *r;
+    HEAP_LOCK();
+    if (heap->quick_total)
+        quick_flush();
+    // 크기 클래스마다 남겨 둔 빈 런도 힙에 돌려줘야 꼭대기가 비워진다
+    for (c = 0; c < SLAB_CLASSES; c++) {
+        r = heap->slab_partial[c];
+        if (r != NULL && r->used == 0) {
+            run_unlink(r);
+            heap->run_map[RUN_PAGE(r)] = 0;
+            free_block(r);
+        }
+    }
+    ret = trim_top(pad);
+    HEAP_UNLOCK();
+    return ret;
 }
+
+/* 블록을 연결하지 않고 quick 리스트에 넣는다. 넣을 수 없는 크기면 0 */
+static int quick_push(void *bp) {
+    size_t size = GET_SIZE(HDRP(bp));
+    int c;
+    if (size > QUICK_MAX_SIZE)
+        return 0;
+    c = size / ALIGNMENT;
+    QUICK_NEXT(bp) = heap->quick_lists[c];
+    heap->quick_lists[c] = bp;
+    heap->quick_total++;
+    if (++heap->quick_count[c] > QUICK_LIMIT || heap->quick_total > QUICK_TOTAL)
+        quick_flush();
+    return 1;
+}
+
+/* 크기가 정확히 asize인 블록을 quick 리스트에서 꺼낸다. 이미 할당 상태다 */
+static void *quick_pop(size_t asize) {
+    void *bp;
+    int c;
+    if (asize > QUICK_MAX_SIZE || (bp = heap->quick_lists[asize / ALIGNMENT]) == NULL)
+        return NULL;
+    c = asize / ALIGNMENT;
+    heap->quick_lists[c] = QUICK_NEXT(bp);
+    heap->quick_count[c]--;
+    heap->quick_total--;
+    return bp;
+}
+
+static int addr_cmp(const void *a, const void *b) {
+    uintptr_t x = (uintptr_t)*(void *const *)a, y = (uintptr_t)*(void *const *)b;
+    return (x > y) - (x < y);
+}
+
+/* quick 리스트의 블록을 모두 주소 순으로 정렬해서 한 번에 연결한다 */
+static void quick_flush(void) {
+    char *bp;
+    int c, n = 0;
+
+    for (c = 0; c <= QUICK_MAX_SIZE / ALIGNMENT; c++) {
+        for (bp = heap->quick_lists[c]; bp != NULL; bp = QUICK_NEXT(bp))
+            heap->quick_buf[n++] = bp;
+        heap->quick_lists[c] = NULL;
+        heap->quick_count[c] = 0;
+    }
+    heap->quick_total = 0;
+    qsort(heap->quick_buf, n, sizeof(void *), addr_cmp);
+    free_sorted(heap->quick_buf, n);
+}
+
+/*
+ * free_sorted - 주소 순으로 정렬된 할당 블록 n개를 돌려준다. 서로 붙어 있는
+ *     블록끼리 먼저 하나로 합친 뒤 묶음마다 한 번만 coalesce한다. 락은 부르는 쪽이 잡는다.
+ */
+static void free_sorted(void **v, size_t n) {
+    char *bp, *epilogue;
+    size_t size, i, j;
+
+    for (i = 0; i < n; i = j) {
+        bp = v[i];
+        size = GET_SIZE(HDRP(bp));
+        for (j = i + 1; j < n && (char *)v[j] == bp + size; j++)
+            size += GET_SIZE(HDRP(v[j]));
+        heap->coalesces += j - i - 1;
+        PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp)), 0));
+        PUT(FTRP(bp), PACK(size, 0, 0));
+        bp = coalesce(bp);
+        CHECK_BLOCK(bp);
+    }
+    /* free_block과 같이, 꼭대기 가용 블록이 크면 힙을 돌려준다 */
+    epilogue = (char *)mem_heap_hi_r(heap->mem) + 1 - WSIZE;
+    if (!GET_PREV_ALLOC(epilogue) && GET_SIZE(epilogue - WSIZE) >= trim_threshold)
+        trim_top(top_pad);
+}
+
+/* bp는 헤더와 풋터가 가용으로 적힌 블록이다. 가용 블록 바로 앞은 항상 할당 블록이다 */
 static void *coalesce(void *bp) {
-    size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
     size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
     size_t size = GET_SIZE(HDRP(bp));
+    heap->coalesces += !prev_alloc + !next_alloc;
     if (prev_alloc && !next_alloc) {
         list_remove(NEXT_BLKP(bp));
         size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
-        PUT(HDRP(bp), PACK(size, 0));
-        PUT(FTRP(bp), PACK(size, 0));
+        PUT(HDRP(bp), PACK(size, 1, 0));
+        PUT(FTRP(bp), PACK(size, 0, 0));
     } else if (!prev_alloc && next_alloc) {
         list_remove(PREV_BLKP(bp));
         size += GET_SIZE(HDRP(PREV_BLKP(bp)));
-        PUT(FTRP(bp), PACK(size, 0));
-        PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
+        PUT(FTRP(bp), PACK(size, 0, 0));
+        PUT(HDRP(PREV_BLKP(bp)), PACK(size, 1, 0));
         bp = PREV_BLKP(bp);
     } else if (!prev_alloc && !next_alloc) {
         list_remove(PREV_BLKP(bp));
         list_remove(NEXT_BLKP(bp));
-        size += GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(FTRP(NEXT_BLKP(bp)));
-        PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
-        PUT(FTRP(NEXT_BLKP(bp)), PACK(size, 0));
+        size += GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(HDRP(NEXT_BLKP(bp)));
+        PUT(HDRP(PREV_BLKP(bp)), PACK(size, 1, 0));
+        PUT(FTRP(NEXT_BLKP(bp)), PACK(size, 0, 0));
         bp = PREV_BLKP(bp);
     }
+    CLR_PREV_ALLOC(NEXT_BLKP(bp));
     list_add(bp);
     return bp;
 }
 
+/*
+ * resize_block - 할당 블록 bp가 total 바이트를 차지하게 된 상태에서 asize만 남기고
+ *     나머지가 최소 블록 이상이면 떼어내 가용 블록으로 돌려준다. 락은 부르는 쪽이 잡는다.
+ */
+static void resize_block(void *bp, size_t total, size_t asize) {
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+    void *rest;
+    if (total - asize >= MIN_BLOCK) {
+        heap->splits++;
+        PUT(HDRP(bp), PACK(asize, prev_alloc, 1));
+        rest = NEXT_BLKP(bp);
+        PUT(HDRP(rest), PACK(total - asize, 1, 0));
+        PUT(FTRP(rest), PACK(total - asize, 0, 0));
+        coalesce(rest);
+    } else {
+        PUT(HDRP(bp), PACK(total, prev_alloc, 1));
+        SET_PREV_ALLOC(NEXT_BLKP(bp));
+    }
+    CHECK_BLOCK(bp);
+}
+
+/* 자리를 옮기든 안 옮기든 realloc 한 번으로 센다 */
 void *mm_realloc(void *ptr, size_t size) {
-    void *oldptr = ptr;
-    void *newptr;
-    size_t copySize;
-    size_t cur_block_size = GET_SIZE(HDRP(ptr));
+    size_t old;
+    void *p;
+
+    if (!LOAD_OPT(stats_on))
+        return realloc_request(ptr, size);
+    old = ptr != NULL ? mm_usable_size(ptr) : 0;
+    p = realloc_request(ptr, size);
 
-    if (size == cur_block_size) {
+    if (ptr == NULL) {
+        if (p != NULL)
+            stat_alloc(mm_usable_size(p));
+    } else if (size == 0) {
+        stat_free(old);
+    } else if (p != NULL) {
+        STAT->alloc_bytes += mm_usable_size(p);
+        STAT->freed_bytes += old;
+        STAT->reallocs++;
+        stat_tick();
+    }
+    return p;
+}
+
+/*
+ * realloc_request - 되도록 제자리에서 크기를 바꾼다.
+ *     줄일 때는 꼬리를 떼어 돌려주고, 늘릴 때는
+ *     (1) 다음 가용 블록을 흡수하고,
+ *     (2) 힙 꼭대기 블록이면 모자란 만큼만 mem_sbrk로 늘리고,
+ *     (3) 앞 가용 블록(+ 다음 가용 블록)과 합쳐 payload를 memmove로 당긴다.
+ *     모두 안 되면 새로 할당해서 복사한다.
+ */
+static void *realloc_request(void *ptr, size_t size) {
+    void *newptr, *next, *prev;
+    size_t copySize, cur_block_size, asize, next_size, prev_size;
+
+    if (ptr == NULL)
+        return malloc_request(size);
+    if (size == 0) {
+        free_request(ptr);
+        return NULL;
+    }
+    // 매핑된 블록은 mem_remap으로 매핑째 늘리거나 줄인다
+    if (IS_MAPPED(ptr)) {
+        if (is_guarded(ptr))
+            return guard_realloc(ptr, size);
+        copySize = size + MAP_OFF(ptr); // 새 매핑 크기
+        if (copySize <= MAP_SIZE(ptr) && copySize > MAP_SIZE(ptr) - mem_pagesize())
+            return ptr;
+        if ((newptr = mem_remap_r(heap->mem, MAP_BASE(ptr), copySize)) == NULL)
+            return NULL;
+        newptr = (char *)newptr + MAP_OFF(ptr);
+        MAP_SIZE(newptr) = ALIGN_PAGE(copySize);
+        return newptr;
+    }
+    // 슬랩 칸에는 헤더가 없다. 칸 안에 들어가면 그대로 쓰고 아니면 옮긴다
+    if (is_slab(ptr)) {
+        copySize = SLAB_RUN(ptr)->size;
+        if (size <= copySize)
+            return ptr;
+        if ((newptr = malloc_request(size)) == NULL)
+            return NULL;
+        memcpy(newptr, ptr, copySize);
+        free_request(ptr);
+        return newptr;
+    }
+    cur_block_size = GET_BLK_SIZE(ptr);
+    // 슬랩 크기로 줄어드는 힙 블록은 칸으로 옮긴다. 그래야 크기만 보고 슬랩인지 안다 (mm_free_sized)
+    if (size <= SLAB_MAX) {
+        if ((newptr = malloc_request(size)) == NULL)
+            return NULL;
+        memcpy(newptr, ptr, size);
+        free_request(ptr);
+        return newptr;
+    }
+    asize = MAX(ALIGN(size + WSIZE), MIN_BLOCK);
+    // 줄이거나 그대로일 때: 남는 꼬리만 돌려준다
+    if (asize <= cur_block_size) {
+        if (cur_block_size - asize >= MIN_BLOCK) {
+            HEAP_LOCK();
+            resize_block(ptr, cur_block_size, asize);
+            HEAP_UNLOCK();
+        }
         return ptr;
     }
 
-    // size가 더 큼
-    // 다음 블록이 free일 때,
-    if (GET_ALLOC(HDRP(NEXT_BLKP(ptr))) == 0 && cur_block_size > size) {
+    // 이웃 블록을 건드리므로 제자리 확장은 락 안에서 한다
+    HEAP_LOCK();
+    next = NEXT_BLKP(ptr);
+    next_size = GET_ALLOC(HDRP(next)) ? 0 : GET_SIZE(HDRP(next));
+    // 힙 꼭대기: 바로 뒤가 에필로그이거나, 뒤의 가용 블록 다음이 에필로그
+    if (cur_block_size + next_size < asize && GET_SIZE(HDRP(next_size ? NEXT_BLKP(next) : next)) == 0) {
+        // 최소 블록보다 작게 늘리면 새 가용 블록의 링크가 에필로그 헤더를 덮어쓴다
+        if (extend_heap(MAX(asize - cur_block_size - next_size, MIN_BLOCK)) != NULL) {
+            next = NEXT_BLKP(ptr);
+            next_size = GET_SIZE(HDRP(next));
+        }
+    }
+    if (cur_block_size + next_size >= asize) {
+        if (next_size)
+            list_remove(next);
+        resize_block(ptr, cur_block_size + next_size, asize);
+        HEAP_UNLOCK();
+        return ptr;
+    }
+    // 앞 블록이 가용이면 앞뒤를 합쳐 payload를 앞으로 당긴다
+    if (!GET_PREV_ALLOC(HDRP(ptr))) {
+        prev = PREV_BLKP(ptr);
+        prev_size = GET_SIZE(HDRP(prev));
+        if (prev_size + cur_block_size + next_size >= asize) {
+            list_remove(prev);
+            if (next_size)
+                list_remove(next);
+            memmove(prev, ptr, cur_block_size - WSIZE);
+            // 가용 블록의 앞은 항상 할당 블록이다
+            PUT(HDRP(prev), PACK(prev_size + cur_block_size + next_size, 1, 1));
+            resize_block(prev, prev_size + cur_block_size + next_size, asize);
+            HEAP_UNLOCK();
+            return prev;
+        }
+    }
+    HEAP_UNLOCK();
 
-        // 다음 free 블록 사이즈
-        size_t next_block_size = GET_SIZE(HDRP(NEXT_BLKP(ptr)));
+    // 이웃으로 모자라면 새로 할당해서 복사한다
+    newptr = malloc_request(size);
+    if (newptr == NULL)
+        return NULL;
+    copySize = cur_block_size - WSIZE; // 할당 블록의 payload는 헤더를 뺀 나머지 전부
+    memcpy(newptr, ptr, copySize);
+    free_request(ptr);
+    return newptr;
+}
+void *mm_calloc(size_t nmemb, size_t size) {
+    void *bp = calloc_request(nmemb, size);
+    if (bp != NULL)
+        STAT_ALLOC(bp);
+    return bp;
+}
 
-        // 더 추가해야할 양
-        size_t remained = size - GET_SIZE(HDRP(ptr));
-        // 다음 프리블록이 더 클 때,
-        if (remained <= next_block_size) {
-            // 남은 블록크기가 최소 프리블록 사이즈 이상일 때,
-            if (16 <= next_block_size - remained) {
-                // 헤드, 푸터 크기 변경
-                PUT(HDRP(ptr), PACK(size, 1));
-                PUT(FTRP(ptr), PACK(size, 1));
+/*
+ * calloc_request - nmemb * size 바이트를 0으로 채워 준다. 한 번도 쓰인 적 없는 힙
+ *     (mem_heap_clean 위)과 매핑은 이미 0이므로, 블록이 그 위에 걸치면 그 아래
+ *     앞부분과 가용 블록일 때 적힌 링크/트리 필드, 끝의 풋터만 지운다.
+ */
+static void *calloc_request(size_t nmemb, size_t size) {
+    size_t bytes, asize, clear;
+    char *bp, *clean, *ftr;
 
-                // 다음 free블록 헤더 푸터 변경
-                PUT(HDRP(NEXT_BLKP(ptr)), PACK(next_block_size - remained, 0));
-                PUT(FTRP(NEXT_BLKP(ptr)), PACK(next_block_size - remained, 0));
+    if (nmemb != 0 && size > (size_t)-1 / nmemb)
+        return NULL;
+    bytes = nmemb * size;
+    if (bytes == 0)
+        return NULL;
+    if (bytes >= LOAD_OPT(mmap_threshold))
+        return map_malloc(bytes, ALIGNMENT);
+    asize = MAX(ALIGN(bytes + WSIZE), MIN_BLOCK);
+    // 슬랩 칸과 스레드 캐시에서 나오는 블록은 전부 지운다
+    if (bytes <= SLAB_MAX || TCACHED(asize)) {
+        if ((bp = malloc_request(bytes)) != NULL)
+            memset(bp, 0, bytes);
+        return bp;
+    }
+    // 표본 칸은 전에 쓰던 페이지를 다시 열어 주는 것이라 지워야 한다
+    if (--sample_left == 0 && (bp = guard_sample(bytes)) != NULL) {
+        memset(bp, 0, bytes);
+        return bp;
+    }
+    HEAP_LOCK();
+    clean = mem_heap_clean_r(heap->mem);
+    bp = malloc_block(asize);
+    HEAP_UNLOCK();
+    if (bp == NULL)
+        return NULL;
+    if (bp + bytes <= clean) {
+        memset(bp, 0, bytes);
+        return bp;
+    }
+    // 가용 블록의 링크와 트리 필드(T_LEFT, T_RIGHT, T_HEIGHT)가 앞에 남아 있을 수 있다
+    clear = MAX((size_t)(clean > bp ? clean - bp : 0), 2 * PSIZE + sizeof(int));
+    memset(bp, 0, clear < bytes ? clear : bytes);
+    // 나누지 않고 통째로 받은 블록이면 끝에 풋터가 남아 있다
+    ftr = bp + GET_BLK_SIZE(bp) - DSIZE;
+    if (ftr >= bp + clear && ftr < bp + bytes)
+        PUT(ftr, 0);
+    return bp;
+}
+
+void *mm_memalign(size_t align, size_t size) {
+    void *bp = memalign_request(align, size);
+    if (bp != NULL)
+        STAT_ALLOC(bp);
+    return bp;
+}
+
+/*
+ * memalign_request - payload가 align(2의 거듭제곱)의 배수인 블록을 준다. 가용 블록에서
+ *     정렬된 자리를 잘라내고, 앞뒤 남는 조각은 가용 블록으로 돌려준다.
+ */
+static void *memalign_request(size_t align, size_t size) {
+    size_t asize;
+    char *bp;
+
+    if (align == 0 || (align & (align - 1)) != 0)
+        return NULL;
+    if (align <= ALIGNMENT)
+        return malloc_request(size);
+    if (size == 0)
+        return NULL;
+    if (size >= LOAD_OPT(mmap_threshold))
+        return map_malloc(size, align);
+    asize = MAX(ALIGN(size + WSIZE), MIN_BLOCK);
+    // 정렬 여유까지 힙에 들어가지 않는 요청은 memalign_block의 need가 넘치기 전에 따로 매핑한다
+    if (align > MAX_HEAP || asize + align + MIN_BLOCK > MAX_HEAP)
+        return map_malloc(size, align);
+    HEAP_LOCK();
+    bp = memalign_block(asize, align);
+    HEAP_UNLOCK();
+    return bp;
+}
+
+/*
+ * mm_malloc_batch - size 바이트 블록 n개를 out에 채우고, 채운 개수를 반환한다.
+ *     힙 블록은 n개가 들어갈 가용 블록 하나를 찾아 한 번에 n조각으로 자른다.
+ */
+size_t mm_malloc_batch(size_t size, size_t n, void **out) {
+    size_t asize, i = 0;
+    int c;
+
+    if (size == 0 || n == 0)
+        return 0;
+    if (size >= LOAD_OPT(mmap_threshold)) {
+        while (i < n && (out[i] = map_malloc(size, ALIGNMENT)) != NULL)
+            i++;
+        return stat_batch(out, i);
+    }
+    HEAP_LOCK();
+    if (size <= SLAB_MAX) {
+        c = SLAB_CLASS(size);
+        while (i < n && (out[i] = slab_malloc(c)) != NULL)
+            i++;
+    } else {
+        asize = MAX(ALIGN(size + WSIZE), MIN_BLOCK);
+        if (batch_blocks(asize, n, out))
+            i = n;
+        else
+            while (i < n && (out[i] = malloc_block(asize)) != NULL)
+                i++;
+    }
+    HEAP_UNLOCK();
+    return stat_batch(out, i);
+}
+
+/* n * asize 이상의 가용 블록 하나를 n개의 할당 블록으로 자른다. 락은 부르는 쪽이 잡는다 */
+static int batch_blocks(size_t asize, size_t n, void **out) {
+    size_t size, prev_alloc, i;
+    char *bp;
+
+    if (asize > MAX_HEAP / n)
+        return 0;
+    // 통째로 들어갈 자리가 없으면 힙을 늘리지 않고 하나씩 빈 틈을 채우게 한다
+    if ((bp = find_fit(n * asize)) == NULL)
+        return 0;
+    size = GET_SIZE(HDRP(bp));
+    prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+    list_remove(bp);
+    heap->splits += n - 1;
+    for (i = 0; i < n - 1; i++, bp += asize, size -= asize) {
+        PUT(HDRP(bp), PACK(asize, prev_alloc, 1));
+        out[i] = bp;
+        prev_alloc = 1;
+    }
+    // 마지막 블록 뒤에 남는 조각은 resize_block이 떼어서 돌려준다
+    PUT(HDRP(bp), PACK(size, prev_alloc, 1));
+    resize_block(bp, size, asize);
+    out[n - 1] = bp;
+    return 1;
+}
+
+/*
+ * mm_free_batch - ptrs의 블록 n개를 한 번에 돌려준다. ptrs를 주소 순으로 정렬하므로
+ *     배열의 순서가 바뀐다. 서로 붙어 있는 힙 블록은 한 번만 연결한다.
+ */
+void mm_free_batch(void **ptrs, size_t n) {
+    size_t i, m = 0;
+
+    if (LOAD_OPT(stats_on))
+        for (i = 0; i < n; i++)
+            if (ptrs[i] != NULL)
+                stat_free(mm_usable_size(ptrs[i]));
+    qsort(ptrs, n, sizeof(void *), addr_cmp);
+    HEAP_LOCK();
+    for (i = 0; i < n; i++) {
+        if (ptrs[i] == NULL)
+            continue;
+        if (IS_MAPPED(ptrs[i]))
+            map_free(ptrs[i]);
+        else if (is_slab(ptrs[i]))
+            slab_free(ptrs[i]);
+        else
+            ptrs[m++] = ptrs[i];
+    }
+    free_sorted(ptrs, m);
+    HEAP_UNLOCK();
+}
+
+/* C11 aligned_alloc. 이 구현에서는 size가 align의 배수가 아니어도 된다 */
+void *mm_aligned_alloc(size_t align, size_t size) {
+    return mm_memalign(align, size);
+}
+
+/* align에 맞는 asize 블록을 잘라낸다. 락은 부르는 쪽이 잡는다 */
+static void *memalign_block(size_t asize, size_t align) {
+    size_t need = asize + align + MIN_BLOCK, size, lead;
+    char *bp, *p;
+
+    /* 어디서 정렬되든 앞 조각이 0이거나 최소 블록 이상이 되도록 넉넉히 찾는다 */
+    if ((bp = find_fit(need)) == NULL && heap->quick_total) {
+        quick_flush();
+        bp = find_fit(need);
+    }
+    if (bp == NULL && (bp = extend_heap(MAX(need, CHUNKSIZE))) == NULL)
+        return NULL;
+    p = ALIGN_UP(bp, align);
+    while (p != bp && p - bp < MIN_BLOCK)
+        p += align;
+    lead = p - bp;
+    if (lead) {
+        heap->splits++;
+        size = GET_SIZE(HDRP(bp));
+        list_remove(bp);
+        PUT(HDRP(bp), PACK(lead, GET_PREV_ALLOC(HDRP(bp)), 0));
+        PUT(FTRP(bp), PACK(lead, 0, 0));
+        list_add(bp);
+        PUT(HDRP(p), PACK(size - lead, 0, 0));
+        PUT(FTRP(p), PACK(size - lead, 0, 0));
+        list_add(p);
+    }
+    place(p, asize);
+    return p;
+}
+
+/* bp에서 RUN_SIZE 정렬 주소까지의 거리. 그 앞 조각도 가용 블록이 될 수 있게 한다 */
+static size_t run_gap(char *bp) {
+    size_t gap = (RUN_SIZE - ((uintptr_t)bp & (RUN_SIZE - 1))) & (RUN_SIZE - 1);
+    if (gap != 0 && gap < MIN_BLOCK)
+        gap += RUN_SIZE;
+    return gap;
+}
+
+/*
+ * run_alloc - RUN_SIZE로 정렬된 런 블록을 잘라낸다.
+ *     (1) 트리에서 런이 들어갈 만한 작은 블록부터 RUN_SCAN개까지 살펴보고,
+ *     (2) 정렬 여유까지 담는 큰 가용 블록을 찾고,
+ *     (3) 그래도 없으면 힙 꼭대기에서 모자란 만큼만 힙을 늘린다.
+ *     정렬 때문에 생기는 앞뒤 조각은 가용 블록으로 인덱스에 돌려준다.
+ */
+static run_t *run_alloc(int cls) {
+    char *brk, *run;
+    char *bp = NULL;
+    size_t avail = 0, gap, rest, prev_alloc;
+    int i;
+    run_t *r;
+
+    for (i = 0, bp = tree_search(RUN_BLOCK_SIZE, NULL); bp != NULL; i++, bp = tree_search(GET_SIZE(HDRP(bp)), bp)) {
+        if (i == RUN_SCAN) {
+            bp = NULL;
+            break;
+        }
+        if (GET_SIZE(HDRP(bp)) >= run_gap(bp) + RUN_BLOCK_SIZE)
+            break;
+    }
+    if (bp == NULL)
+        bp = find_fit(2 * RUN_BLOCK_SIZE);
+    if (bp == NULL) {
+        brk = (char *)mem_heap_hi_r(heap->mem) + 1;
+        bp = brk;
+        /* 에필로그 헤더의 비트로 마지막 블록이 가용인지 본다 */
+        if (!GET_PREV_ALLOC(brk - WSIZE)) {
+            bp = PREV_BLKP(brk);
+            avail = GET_SIZE(HDRP(bp));
+        }
+        if (avail < run_gap(bp) + RUN_BLOCK_SIZE) {
+            if ((bp = extend_heap(run_gap(bp) + RUN_BLOCK_SIZE - avail)) == NULL)
+                return NULL;
+        }
+    }
+
+    gap = run_gap(bp);
+    rest = GET_SIZE(HDRP(bp)) - gap;
+    prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+    list_remove(bp);
+    if (gap != 0) {
+        heap->splits++;
+        PUT(HDRP(bp), PACK(gap, prev_alloc, 0));
+        PUT(FTRP(bp), PACK(gap, 0, 0));
+        list_add(bp);
+        prev_alloc = 0;
+    }
+    run = bp + gap;
+    if (rest - RUN_BLOCK_SIZE >= MIN_BLOCK) {
+        heap->splits++;
+        PUT(HDRP(run), PACK(RUN_BLOCK_SIZE, prev_alloc, 1));
+        bp = NEXT_BLKP(run);
+        PUT(HDRP(bp), PACK(rest - RUN_BLOCK_SIZE, 1, 0));
+        PUT(FTRP(bp), PACK(rest - RUN_BLOCK_SIZE, 0, 0));
+        list_add(bp);
+    } else {
+        PUT(HDRP(run), PACK(rest, prev_alloc, 1));
+        SET_PREV_ALLOC(NEXT_BLKP(run));
+    }
+
+    r = (run_t *)run;
+    r->prev = NULL;
+    r->next = NULL;
+    r->free = NULL;
+    r->size = slab_sizes[cls];
+    r->nslots = (RUN_SIZE - RUN_HDR_SIZE) / r->size;
+    r->bump = 0;
+    r->used = 0;
+    r->cls = cls;
+    heap->run_map[RUN_PAGE(run)] = 1;
+    CHECK_BLOCK(run);
+    return r;
+}
+
+static void run_unlink(run_t *r) {
+    if (r->prev != NULL)
+        r->prev->next = r->next;
+    else
+        heap->slab_partial[r->cls] = r->next;
+    if (r->next != NULL)
+        r->next->prev = r->prev;
+}
+
+static void run_push(run_t *r) {
+    r->prev = NULL;
+    r->next = heap->slab_partial[r->cls];
+    if (r->next != NULL)
+        r->next->prev = r;
+    heap->slab_partial[r->cls] = r;
+}
+
+/* 빈 칸이 있는 런에서 칸 하나를 꺼낸다. 런이 가득 차면 리스트에서 뺀다 */
+static void *slab_malloc(int cls) {
+    run_t *r = heap->slab_partial[cls];
+    void *p;
+    if (r == NULL) {
+        if ((r = run_alloc(cls)) == NULL)
+            return NULL;
+        run_push(r);
+    }
+    if (r->free != NULL) {
+        p = r->free;
+        r->free = SLOT_NEXT(p);
+    } else {
+        p = (char *)r + RUN_HDR_SIZE + r->bump * r->size;
+        r->bump++;
+    }
+    r->used++;
+    if (r->free == NULL && r->bump == r->nslots)
+        run_unlink(r);
+    return p;
+}
+
+/* 칸을 런에 돌려준다. 빈 런은 같은 클래스에 다른 런이 있으면 힙에 돌려준다 */
+static void slab_free(void *p) {
+    run_t *r = SLAB_RUN(p);
+    if (r->free == NULL && r->bump == r->nslots)
+        run_push(r);
+    SLOT_NEXT(p) = r->free;
+    r->free = p;
+    r->used--;
+    if (r->used == 0 && (r->prev != NULL || r->next != NULL)) {
+        run_unlink(r);
+        heap->run_map[RUN_PAGE(r)] = 0;
+        free_block(r);
+    }
+}
+
+static int is_slab(void *p) {
+    return heap->run_map[RUN_PAGE(p)];
+}
 
-                coalesce(NEXT_BLKP(ptr));
+/*
+ * mm_checkheap - 현재 힙 전체가 일관적인지 확인한다. 문제마다 stderr에 한 줄씩 쓰고,
+ *     문제가 없으면 0, 있으면 -1을 반환한다. verbose면 블록을 하나씩 출력한다.
+ */
+int mm_checkheap(int verbose) {
+    int ret;
+    HEAP_LOCK();
+    ret = check_full(verbose);
+    HEAP_UNLOCK();
+    return ret ? -1 : 0;
+}
+
+/* 블록을 고친 함수 끝에서 불린다. 락은 부르는 쪽이 잡고 있다 */
+static void check_op(void *bp) {
+    if ((LOAD_OPT(check_level) > 1 ? check_full(0) : check_local(bp)) != 0)
+        abort();
+}
+
+static int check_error(void *bp, const char *msg) {
+    fprintf(stderr, "mm_checkheap: block %p: %s\n", bp, msg);
+    return 1;
+}
+
+/* p가 프롤로그 뒤, 에필로그 앞의 payload 자리인가 */
+static int in_heap(void *p) {
+    return (char *)p > heap->listp && (char *)p < (char *)mem_heap_hi_r(heap->mem) + 1 - WSIZE;
+}
+
+/* 트리에서 (크기, 주소)로 bp를 찾는다 */
+static int t_contains(void *bp) {
+    void *n = heap->tree_root;
+    while (n != NULL && n != bp)
+        n = T_LESS(bp, n) ? T_LEFT(n) : T_RIGHT(n);
+    return n != NULL;
+}
+
+/*
+ * check_block - 블록 하나와 다음 블록 헤더의 이전 할당 비트를 확인한다. 가용 블록은
+ *     풋터, 연결 여부와 함께 가용 리스트의 앞뒤 노드나 트리에 제대로 들어 있는지 본다.
+ */
+static int check_block(void *bp) {
+    size_t size = GET_SIZE(HDRP(bp));
+    void *pred, *succ;
+    int fl, sl;
+
+    if (!in_heap(bp))
+        return check_error(bp, "outside the heap");
+    if ((uintptr_t)bp % ALIGNMENT)
+        return check_error(bp, "payload not aligned");
+    if (size < MIN_BLOCK || size % ALIGNMENT)
+        return check_error(bp, "bad size in header");
+    if ((char *)bp + size > (char *)mem_heap_hi_r(heap->mem) + 1)
+        return check_error(bp, "runs past the epilogue");
+    if (GET_PREV_ALLOC(HDRP(NEXT_BLKP(bp))) != GET_ALLOC(HDRP(bp)))
+        return check_error(bp, "next block's prev-alloc bit is wrong");
+    if (GET_ALLOC(HDRP(bp)))
+        return 0;
+
+    if (GET_SIZE(FTRP(bp)) != size || GET_ALLOC(FTRP(bp)))
+        return check_error(bp, "header and footer differ");
+    if (!GET_PREV_ALLOC(HDRP(bp)) || !GET_ALLOC(HDRP(NEXT_BLKP(bp))))
+        return check_error(bp, "free block not coalesced");
+    if (size >= TREE_MIN_SIZE) {
+        if (!t_contains(bp))
+            return check_error(bp, "large free block missing from the tree");
+        return 0;
+    }
+    pred = GET_PRED(bp);
+    succ = GET_SUCC(bp);
+    mapping_insert(size, &fl, &sl);
+    if (pred == NULL ? heap->free_lists[fl][sl] != bp : !in_heap(pred) || GET_SUCC(pred) != bp)
+        return check_error(bp, "free list predecessor does not lead here");
+    if (succ != NULL && (!in_heap(succ) || GET_PRED(succ) != bp))
+        return check_error(bp, "free list successor does not lead back");
+    if (!(heap->sl_bitmap[fl] & (1U << sl)) || !(heap->fl_bitmap & (1U << fl)))
+        return check_error(bp, "bitmap bit clear for a non-empty list");
+    return 0;
+}
+
+/* 에필로그 헤더를 확인한다 */
+static int check_epilogue(void) {
+    char *epilogue = (char *)mem_heap_hi_r(heap->mem) + 1 - WSIZE;
+    if (GET_SIZE(epilogue) != 0 || !GET_ALLOC(epilogue))
+        return check_error(epilogue + WSIZE, "bad epilogue");
+    return 0;
+}
+
+/*
+ * check_local - 방금 고친 블록 bp와 그 앞뒤 블록만 확인한다. 앞 블록은 가용일 때만
+ *     풋터로 찾을 수 있는데, 할당 블록이면 bp의 이전 할당 비트로 이미 확인된 셈이다.
+ */
+static int check_local(void *bp) {
+    int err;
+    if (bp == NULL)
+        return check_epilogue();
+    if ((err = check_block(bp)) != 0)
+        return err;
+    if (!GET_PREV_ALLOC(HDRP(bp)))
+        err |= check_block(PREV_BLKP(bp));
+    if (GET_SIZE(HDRP(NEXT_BLKP(bp))) == 0)
+        err |= check_epilogue();
+    else
+        err |= check_block(NEXT_BLKP(bp));
+    return err;
+}
+
+/* 서브트리 n이 (lo, hi) 사이에 순서대로 있고 높이와 균형이 맞는지 본다. 노드 수를 *count에 더한다 */
+static int check_tree(void *n, void *lo, void *hi, size_t *count) {
+    int hl, hr, err = 0;
+    if (n == NULL)
+        return 0;
+    if (!in_heap(n) || GET_ALLOC(HDRP(n)) || GET_SIZE(HDRP(n)) < TREE_MIN_SIZE)
+        return check_error(n, "tree node is not a large free block");
+    if ((lo != NULL && !T_LESS(lo, n)) || (hi != NULL && !T_LESS(n, hi)))
+        err |= check_error(n, "tree out of order");
+    hl = T_LEFT(n) ? T_HEIGHT(T_LEFT(n)) : 0;
+    hr = T_RIGHT(n) ? T_HEIGHT(T_RIGHT(n)) : 0;
+    if (T_HEIGHT(n) != MAX(hl, hr) + 1 || hl - hr > 1 || hr - hl > 1)
+        err |= check_error(n, "tree height or balance wrong");
+    (*count)++;
+    err |= check_tree(T_LEFT(n), lo, n, count);
+    err |= check_tree(T_RIGHT(n), n, hi, count);
+    return err;
+}
+
+/* 런 헤더와 반납된 칸의 리스트를 확인한다 */
+static int check_run(run_t *r) {
+    size_t nfree = 0;
+    char *p;
+    if (r->cls >= SLAB_CLASSES || r->size != slab_sizes[r->cls] ||
+        r->nslots != (RUN_SIZE - RUN_HDR_SIZE) / r->size || r->used > r->bump || r->bump > r->nslots)
+        return check_error(r, "bad slab run header");
+    for (p = r->free; p != NULL && nfree <= r->nslots; p = SLOT_NEXT(p), nfree++)
+        if (SLAB_RUN(p) != r || (p - (char *)r - RUN_HDR_SIZE) % r->size != 0 ||
+            p >= (char *)r + RUN_HDR_SIZE + r->bump * r->size)
+            return check_error(r, "slab free slot outside the run");
+    if (nfree != (size_t)(r->bump - r->used))
+        return check_error(r, "slab free count does not match");
+    return 0;
+}
+
+/*
+ * check_full - 힙을 프롤로그부터 에필로그까지 훑으며 블록마다 check_block을 하고,
+ *     가용 블록 수를 가용 리스트와 트리의 노드 수와 맞춰 본다. 리스트 노드는
+ *     모두 자기 구간에 맞는 가용 블록이어야 하고 비트맵과 맞아야 한다.
+ */
+static int check_full(int verbose) {
+    size_t nlist = 0, ntree = 0, walk_list = 0, walk_tree = 0, n;
+    int err = 0, fl, sl, f, s, c;
+    char *bp;
+    void *p;
+    run_t *r;
+
+    if (GET(HDRP(heap->listp)) != PACK(DSIZE, 1, 1) || GET(FTRP(heap->listp)) != PACK(DSIZE, 1, 1))
+        err |= check_error(heap->listp, "bad prologue");
+    for (bp = NEXT_BLKP(heap->listp); GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
+        if (verbose)
+            printf("%p: size %u, %s%s\n", bp, GET_SIZE(HDRP(bp)), GET_ALLOC(HDRP(bp)) ? "allocated" : "free",
+                   GET_PREV_ALLOC(HDRP(bp)) ? "" : ", previous free");
+        if (check_block(bp))
+            return 1; // 크기를 믿을 수 없으니 더 걷지 않는다
+        if (!GET_ALLOC(HDRP(bp))) {
+            if (GET_SIZE(HDRP(bp)) >= TREE_MIN_SIZE)
+                walk_tree++;
+            else
+                walk_list++;
+        } else if (((uintptr_t)bp & (RUN_SIZE - 1)) == 0 && heap->run_map[RUN_PAGE(bp)]) {
+            err |= check_run((run_t *)bp);
+        }
+    }
+    err |= check_epilogue();
+
+    for (fl = 0; fl < FL_INDEX_COUNT; fl++) {
+        if (!(heap->fl_bitmap & (1U << fl)) != !heap->sl_bitmap[fl])
+            err |= check_error(NULL, "first-level bitmap disagrees with second level");
+        for (sl = 0; sl < SL_INDEX_COUNT; sl++) {
+            p = heap->free_lists[fl][sl];
+            if (!(heap->sl_bitmap[fl] & (1U << sl)) != (p == NULL))
+                err |= check_error(p, "second-level bitmap disagrees with list");
+            for (n = 0; p != NULL; p = GET_SUCC(p), n++) {
+                if (n > walk_list)
+                    return err | check_error(heap->free_lists[fl][sl], "free list has a cycle");
+                if (!in_heap(p) || GET_ALLOC(HDRP(p)))
+                    return err | check_error(p, "free list node is not a free block");
+                mapping_insert(GET_SIZE(HDRP(p)), &f, &s);
+                if (f != fl || s != sl)
+                    err |= check_error(p, "free block in the wrong size list");
+            }
+            nlist += n;
+        }
+    }
+    err |= check_tree(heap->tree_root, NULL, NULL, &ntree);
+    if (nlist != walk_list)
+        err |= check_error(NULL, "free list count differs from heap walk");
+    if (ntree != walk_tree)
+        err |= check_error(NULL, "tree node count differs from heap walk");
+
+    for (c = 0; c < SLAB_CLASSES; c++)
+        for (r = heap->slab_partial[c]; r != NULL; r = r->next)
+            if (!in_heap(r) || !heap->run_map[RUN_PAGE(r)] || r->cls != (unsigned int)c ||
+                (r->next != NULL && r->next->prev != r) || (r->free == NULL && r->bump == r->nslots))
+                return err | check_error(r, "bad run on the partial list");
+    for (c = 0; c <= QUICK_MAX_SIZE / ALIGNMENT; c++)
+        for (p = heap->quick_lists[c]; p != NULL; p = QUICK_NEXT(p))
+            if (!in_heap(p) || !GET_ALLOC(HDRP(p)))
+                return err | check_error(p, "quick list block is not allocated");
+    return err;
+}
+
+static void stat_alloc(size_t n) {
+    STAT->alloc_bytes += n;
+    STAT->mallocs++;
+    stat_tick();
+}
+
+static void stat_free(size_t n) {
+    STAT->freed_bytes += n;
+    STAT->frees++;
+    stat_tick();
+}
+
+/* mm_malloc_batch가 내준 블록 n개를 세고 n을 그대로 돌려준다 */
+static size_t stat_batch(void **out, size_t n) {
+    size_t i;
+    if (LOAD_OPT(stats_on))
+        for (i = 0; i < n; i++)
+            stat_alloc(mm_usable_size(out[i]));
+    return n;
+}
+
+/* 연산 하나를 센 뒤에 부른다. 혼자 쓰면 최고치를 바로 고치고, 스레드별이면 모아서 더한다 */
+static void stat_tick(void) {
+#ifdef MM_THREAD_SAFE
+    if (++stat_local.pending >= STATS_FLUSH)
+        stat_flush();
+#else
+    if (stat_total.alloc_bytes - stat_total.freed_bytes > stat_peak)
+        stat_peak = stat_total.alloc_bytes - stat_total.freed_bytes;
+#endif
+}
+
+/*
+ * stat_flush - 이 스레드의 카운터를 전역 합계에 더하고 비운다. 최고치는 더한 뒤의
+ *     합계로 고치므로 STATS_FLUSH 연산 단위로 근사한 값이다.
+ */
+static void stat_flush(void) {
+#ifdef MM_THREAD_SAFE
+    size_t alloc, freed, peak;
+    if (stat_local.pending == 0)
+        return;
+    alloc = __atomic_add_fetch(&stat_total.alloc_bytes, stat_local.alloc_bytes, __ATOMIC_RELAXED);
+    freed = __atomic_add_fetch(&stat_total.freed_bytes, stat_local.freed_bytes, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stat_total.mallocs, stat_local.mallocs, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stat_total.frees, stat_local.frees, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stat_total.reallocs, stat_local.reallocs, __ATOMIC_RELAXED);
+    memset(&stat_local, 0, sizeof(stat_local));
+    peak = __atomic_load_n(&stat_peak, __ATOMIC_RELAXED);
+    while (alloc > freed && alloc - freed > peak &&
+           !__atomic_compare_exchange_n(&stat_peak, &peak, alloc - freed, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+#endif
+}
+
+/* 트리 노드를 세어 st의 마지막 구간에 더한다 */
+static void stat_tree(void *n, mm_stats_t *st) {
+    if (n == NULL)
+        return;
+    st->bin_blocks[MM_STATS_BINS - 1]++;
+    st->bin_bytes[MM_STATS_BINS - 1] += GET_SIZE(HDRP(n));
+    stat_tree(T_LEFT(n), st);
+    stat_tree(T_RIGHT(n), st);
+}
+
+/*
+ * mm_stats - 현재 힙의 통계를 st에 채운다. 구간은 TLSF (fl, sl) 리스트를 차례로 놓고
+ *     마지막에 트리를 둔다. 요청 수와 바이트는 모든 스레드를 합친 것인데, 다른
+ *     스레드가 아직 더하지 않은 STATS_FLUSH 미만의 연산은 빠진다.
+ */
+void mm_stats(mm_stats_t *st) {
+    int fl, sl, i;
+    void *p, *n;
+
+    memset(st, 0, sizeof(*st));
+    stat_flush();
+    st->live_bytes = LOAD_OPT(stat_total.alloc_bytes) - LOAD_OPT(stat_total.freed_bytes);
+    st->peak_bytes = MAX(LOAD_OPT(stat_peak), st->live_bytes);
+    st->mallocs = LOAD_OPT(stat_total.mallocs);
+    st->frees = LOAD_OPT(stat_total.frees);
+    st->reallocs = LOAD_OPT(stat_total.reallocs);
+    st->mapped_bytes = mem_mapsize_r(heap->mem);
+
+    HEAP_LOCK();
+    st->heap_size = mem_heapsize_r(heap->mem);
+    st->splits = heap->splits;
+    st->coalesces = heap->coalesces;
+    st->sbrk_calls = heap->sbrks;
+    st->quick_blocks = heap->quick_total;
+    for (fl = 0; fl < FL_INDEX_COUNT; fl++) {
+        for (sl = 0; sl < SL_INDEX_COUNT; sl++) {
+            i = fl * SL_INDEX_COUNT + sl;
+            // 구간의 가장 작은 크기: mapping_insert의 반대
+            if (fl == 0)
+                st->bin_min[i] = sl * (SMALL_BLOCK_SIZE / SL_INDEX_COUNT);
+            else
+                st->bin_min[i] = (size_t)(SL_INDEX_COUNT + sl) << (fl + FL_INDEX_SHIFT - 1 - SL_INDEX_COUNT_LOG2);
+            for (p = heap->free_lists[fl][sl]; p != NULL; p = GET_SUCC(p)) {
+                st->bin_blocks[i]++;
+                st->bin_bytes[i] += GET_SIZE(HDRP(p));
+                st->largest_free = MAX(st->largest_free, GET_SIZE(HDRP(p)));
             }
-            // 남은 블록 크기가 최소 사이즈보다 작을 때
-            else {
-                size_t cur_size = GET_SIZE(HDRP(ptr));
-                size_t next_size = GET_SIZE(HDRP(NEXT_BLKP(ptr)));
+        }
+    }
+    st->bin_min[MM_STATS_BINS - 1] = TREE_MIN_SIZE;
+    stat_tree(heap->tree_root, st);
+    // 트리에서 가장 큰 블록은 가장 오른쪽 노드다
+    for (n = heap->tree_root; n != NULL && T_RIGHT(n) != NULL; n = T_RIGHT(n))
+        ;
+    if (n != NULL)
+        st->largest_free = MAX(st->largest_free, GET_SIZE(HDRP(n)));
+    HEAP_UNLOCK();
+    for (i = 0; i < MM_STATS_BINS; i++) {
+        st->free_blocks += st->bin_blocks[i];
+        st->free_bytes += st->bin_bytes[i];
+    }
+}
 
-                PUT(HDRP(ptr), PACK(cur_size + next_size, 1));
-                PUT(FTRP(ptr), PACK(cur_size + next_size, 1));
+/*
+ * mm_stats_print - mm_stats를 fp에 쓴다. MM_STATS_TEXT는 사람이 읽는 표,
+ *     MM_STATS_JSON은 다른 JSON 안에 넣을 수 있게 줄바꿈 없는 객체 하나다. 빈 구간은 빼고 쓴다.
+ */
+void mm_stats_print(FILE *fp, int format) {
+    mm_stats_t st;
+    int i, first = 1;
+
+    mm_stats(&st);
+    if (format == MM_STATS_JSON) {
+        fprintf(fp, "{\"live_bytes\":%lu,\"peak_bytes\":%lu,\"heap_size\":%lu,\"mapped_bytes\":%lu,"
+                    "\"mallocs\":%lu,\"frees\":%lu,\"reallocs\":%lu,\"splits\":%lu,\"coalesces\":%lu,"
+                    "\"sbrk_calls\":%lu,\"free_blocks\":%lu,\"free_bytes\":%lu,\"largest_free\":%lu,"
+                    "\"quick_blocks\":%lu,\"bins\":[",
+                (unsigned long)st.live_bytes, (unsigned long)st.peak_bytes, (unsigned long)st.heap_size,
+                (unsigned long)st.mapped_bytes, st.mallocs, st.frees, st.reallocs, st.splits, st.coalesces,
+                st.sbrk_calls, (unsigned long)st.free_blocks, (unsigned long)st.free_bytes,
+                (unsigned long)st.largest_free, (unsigned long)st.quick_blocks);
+        for (i = 0; i < MM_STATS_BINS; i++) {
+            if (st.bin_blocks[i] == 0)
+                continue;
+            fprintf(fp, "%s{\"bin\":%d,\"min_size\":%lu,\"blocks\":%lu,\"bytes\":%lu}", first ? "" : ",", i,
+                    (unsigned long)st.bin_min[i], (unsigned long)st.bin_blocks[i], (unsigned long)st.bin_bytes[i]);
+            first = 0;
+        }
+        fprintf(fp, "]}");
+        return;
+    }
+    fprintf(fp, "heap %lu bytes, mapped %lu bytes, live %lu bytes (peak %lu)\n", (unsigned long)st.heap_size,
+            (unsigned long)st.mapped_bytes, (unsigned long)st.live_bytes, (unsigned long)st.peak_bytes);
+    fprintf(fp, "requests: %lu malloc, %lu free, %lu realloc\n", st.mallocs, st.frees, st.reallocs);
+    fprintf(fp, "blocks: %lu splits, %lu coalesces, %lu mem_sbrk calls\n", st.splits, st.coalesces, st.sbrk_calls);
+    fprintf(fp, "free: %lu blocks, %lu bytes, largest %lu, %lu on quick lists\n", (unsigned long)st.free_blocks,
+            (unsigned long)st.free_bytes, (unsigned long)st.largest_free, (unsigned long)st.quick_blocks);
+    if (st.free_blocks == 0)
+        return;
+    fprintf(fp, "%6s%10s%8s%10s\n", "bin", "min size", "blocks", "bytes");
+    for (i = 0; i < MM_STATS_BINS; i++)
+        if (st.bin_blocks[i] != 0)
+            fprintf(fp, "%6s%10lu%8lu%10lu\n", i == MM_STATS_BINS - 1 ? "tree" : "", (unsigned long)st.bin_min[i],
+                    (unsigned long)st.bin_blocks[i], (unsigned long)st.bin_bytes[i]);
+}
+
+#ifdef MM_THREAD_SAFE
+/* 캐시 클래스를 구한다. 캐시하지 않는 블록이면 -1 */
+static int tcache_class(void *bp) {
+    size_t size;
+    if (is_slab(bp))
+        return SLAB_RUN(bp)->cls;
+    size = GET_BLK_SIZE(bp);
+    return size <= TCACHE_MAX_SIZE ? TCACHE_IDX(size) : -1;
+}
+
+/* 블록 하나를 c 클래스 캐시에 넣는다. 캐시할 수 없는 크기거나 가득 찼으면 0 */
+static int tcache_push(void *bp, int c) {
+    if (c < 0 || tcache.count[c] >= TCACHE_MAX)
+        return 0;
+    TC_NEXT(bp) = tcache.head[c];
+    tcache.head[c] = bp;
+    tcache.count[c]++;
+    return 1;
+}
+
+static void *tcache_pop(int c) {
+    void *bp = tcache.head[c];
+    tcache.head[c] = TC_NEXT(bp);
+    tcache.count[c]--;
+    return bp;
+}
+
+/* 스레드가 끝날 때 남은 블록을 모두 기본 힙에 돌려준다 */
+static void tcache_destroy(void *arg) {
+    tcache_t *tc = arg;
+    void *bp;
+    int c;
+    stat_flush();
+    heap = &main_heap;
+    HEAP_LOCK();
+    if (tc->gen == heap_gen) {
+        for (c = 0; c < TCACHE_CLASSES; c++) {
+            while ((bp = tc->head[c]) != NULL) {
+                tc->head[c] = TC_NEXT(bp);
+                free_locked(bp);
             }
+            tc->count[c] = 0;
+        }
+    }
+    HEAP_UNLOCK();
+}
 
-            return ptr;
+static void tcache_key_init(void) {
+    pthread_key_create(&tcache_key, tcache_destroy);
+}
+
+/* 이 스레드의 캐시를 처음 쓰거나 힙이 다시 초기화됐으면 캐시를 비운다 */
+static void tcache_check(void) {
+    if (tcache.gen == heap_gen)
+        return;
+    memset(&tcache, 0, sizeof(tcache));
+    tcache.gen = heap_gen;
+    pthread_once(&tcache_once, tcache_key_init);
+    pthread_setspecific(tcache_key, &tcache);
+}
+
+/*
+ * tcache_get - 캐시에 있으면 락 없이 꺼낸다. 비었으면 락을 한 번 잡고
+ *     요청한 블록과 함께 TCACHE_BATCH - 1개를 더 잘라 캐시를 채운다.
+ *     c가 슬랩 클래스면 asize는 쓰지 않는다.
+ */
+static void *tcache_get(int c, size_t asize) {
+    void *bp, *p;
+    int i;
+    tcache_check();
+    if (tcache.head[c] != NULL)
+        return tcache_pop(c);
+
+    HEAP_LOCK();
+    if (c < SLAB_CLASSES) {
+        bp = slab_malloc(c);
+        for (i = 1; bp != NULL && i < TCACHE_BATCH; i++) {
+            if ((p = slab_malloc(c)) == NULL)
+                break;
+            tcache_push(p, c);
         }
+        HEAP_UNLOCK();
+        return bp;
+    }
+    bp = malloc_block(asize);
+    for (i = 1; bp != NULL && i < TCACHE_BATCH; i++) {
+        /* 캐시를 채우려고 힙을 늘리지는 않는다 */
+        if ((p = find_fit(asize)) == NULL)
+            break;
+        place(p, asize);
+        /* 쪼개지지 않아 더 커진 블록은 제 크기의 캐시로 가거나 힙으로 돌아간다 */
+        if (!tcache_push(p, tcache_class(p)))
+            free_block(p);
     }
+    HEAP_UNLOCK();
+    return bp;
+}
 
-    // 다음블록이 free블록이지만 작을 때 or 할당블록일 때는 새로 할당
-    newptr = mm_malloc(size);
-    if (newptr == NULL)
-        return NULL;
-    copySize = *(size_t *)((char *)oldptr - WSIZE) - 1; // oldptr은 payload를 가리키고, 헤더를 가려면 -4 해야함, 여기엔 할당비트 포함되어 있으므로 -1 해줘서 해당 할당블록의 크기를 구함
-    if (size < copySize)
-        copySize = size;
-    memcpy(newptr, oldptr, copySize);
-    mm_free(oldptr);
-    return newptr;
-}
\ No newline at end of file
+/*
+ * tcache_put - 작은 블록은 락 없이 c 클래스 캐시에 넣는다. 캐시가 가득 찼으면
+ *     락을 한 번 잡고 TCACHE_BATCH개를 공유 힙에 돌려준 뒤 넣는다.
+ */
+static int tcache_put(void *bp, int c) {
+    void *first, *last;
+    int i;
+    if (c < 0)
+        return 0;
+    tcache_check();
+    if (tcache.count[c] >= TCACHE_MAX) {
+        if (HEAP_TRYLOCK()) {
+            for (i = 0; i < TCACHE_BATCH; i++)
+                free_locked(tcache_pop(c));
+            HEAP_UNLOCK();
+        } else {
+            /* 락을 기다리지 않고 앞의 TCACHE_BATCH개를 사슬째 원격 스택에 넣는다 */
+            first = last = tcache.head[c];
+            for (i = 1; i < TCACHE_BATCH; i++)
+                last = TC_NEXT(last);
+            tcache.head[c] = TC_NEXT(last);
+            tcache.count[c] -= TCACHE_BATCH;
+            remote_push(first, last);
+        }
+    }
+    return tcache_push(bp, c);
+}
+
+/* 락을 잡고, 그동안 원격 스택에 쌓인 블록이 있으면 돌려준다 */
+static void heap_lock_acquire(void) {
+    pthread_mutex_lock(&heap->lock);
+    if (__atomic_load_n(&heap->remote_head, __ATOMIC_RELAXED) != NULL)
+        remote_drain();
+}
+
+/* 락이 비어 있을 때만 잡는다. 잡았으면 1 */
+static int heap_lock_try(void) {
+    if (pthread_mutex_trylock(&heap->lock) != 0)
+        return 0;
+    if (__atomic_load_n(&heap->remote_head, __ATOMIC_RELAXED) != NULL)
+        remote_drain();
+    return 1;
+}
+
+/* REMOTE_NEXT로 이어진 first..last 사슬을 CAS 한 번으로 원격 스택에 넣는다 */
+static void remote_push(void *first, void *last) {
+    void *head = __atomic_load_n(&heap->remote_head, __ATOMIC_RELAXED);
+    do
+        REMOTE_NEXT(last) = head;
+    while (!__atomic_compare_exchange_n(&heap->remote_head, &head, first, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/* 원격 스택을 통째로 꺼내 공유 힙에 돌려준다. 락은 부르는 쪽이 잡는다 */
+static void remote_drain(void) {
+    void *bp = __atomic_exchange_n(&heap->remote_head, NULL, __ATOMIC_ACQUIRE), *next;
+    while (bp != NULL) {
+        next = REMOTE_NEXT(bp);
+        free_locked(bp);
+        bp = next;
+    }
+}
+#endif
@@ -3,7 +3,71 @@
 extern int mm_init (void);
 extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
+extern void mm_free_sized(void *ptr, size_t size);
+extern size_t mm_usable_size(void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
+extern void *mm_calloc(size_t nmemb, size_t size);
+extern void *mm_memalign(size_t align, size_t size);
+extern void *mm_aligned_alloc(size_t align, size_t size);
+extern size_t mm_malloc_batch(size_t size, size_t n, void **out);
+extern void mm_free_batch(void **ptrs, size_t n);
+extern int mm_trim(size_t pad);
+extern int mm_mallopt(int param, int value);
+extern int mm_checkheap(int verbose);
+
+/*
+ * Allocator statistics, filled in by mm_stats. The request counts and
+ * byte totals (live/peak bytes, mallocs, frees, reallocs) stay 0 unless
+ * mm_mallopt(MM_STATS, 1) was called; the rest is read from the heap.
+ */
+#define MM_STATS_BINS 65 /* 64 segregated lists for blocks under 1KB, then the tree */
+typedef struct {
+    size_t live_bytes;       /* usable bytes handed out and not yet freed */
+    size_t peak_bytes;       /* largest live_bytes since mm_init */
+    size_t heap_size;        /* bytes between mem_heap_lo and mem_heap_hi */
+    size_t mapped_bytes;     /* bytes in separate mappings */
+    unsigned long mallocs;   /* blocks handed out, batch and calloc included */
+    unsigned long frees;
+    unsigned long reallocs;
+    unsigned long splits;    /* free blocks cut in two */
+    unsigned long coalesces; /* pairs of free blocks merged */
+    unsigned long sbrk_calls;
+    size_t free_blocks;      /* blocks in the free lists and tree */
+    size_t free_bytes;
+    size_t largest_free;
+    size_t quick_blocks;     /* freed blocks waiting on quick lists */
+    size_t bin_min[MM_STATS_BINS];    /* smallest block size that goes in each bin */
+    size_t bin_blocks[MM_STATS_BINS];
+    size_t bin_bytes[MM_STATS_BINS];
+} mm_stats_t;
+
+/* mm_stats_print formats */
+#define MM_STATS_TEXT 0
+#define MM_STATS_JSON 1
+
+extern void mm_stats(mm_stats_t *st);
+extern void mm_stats_print(FILE *fp, int format);
+
+/* Independent heaps, each with its own memlib region */
+typedef struct mm_heap mm_heap_t;
+
+extern mm_heap_t *mm_heap_create(void);
+extern void mm_heap_destroy(mm_heap_t *h);
+extern void *mm_heap_malloc(mm_heap_t *h, size_t size);
+extern void *mm_heap_calloc(mm_heap_t *h, size_t nmemb, size_t size);
+extern void *mm_heap_memalign(mm_heap_t *h, size_t align, size_t size);
+extern void *mm_heap_realloc(mm_heap_t *h, void *ptr, size_t size);
+extern void mm_heap_free(mm_heap_t *h, void *ptr);
+
+/* mm_mallopt parameters */
+#define MM_MMAP_THRESHOLD 1 /* requests of this size and up get their own mapping */
+#define MM_TRIM_THRESHOLD 2 /* free top chunk size that triggers a trim */
+#define MM_TOP_PAD        3 /* bytes kept at the top of the heap on trim */
+#define MM_DEFER_COALESCE 4 /* nonzero: park freed blocks on quick lists */
+#define MM_GUARD_SAMPLE   5 /* put about 1 in N requests before a guard page, 0 = off */
+#define MM_GUARD_SLOTS    6 /* sampled blocks that can be live at once */
+#define MM_CHECK_HEAP     7 /* check each change: 1 = blocks touched, 2 = whole heap */
+#define MM_STATS          8 /* nonzero: count requests for mm_stats, set before mm_init */
 
 
 /* 
@@ -0,0 +1,215 @@
+/*
+ * mm_bench.cc - 표준 컨테이너의 할당 패턴으로 mm.c를 new/delete와 견준다.
+ *
+ *     ./mm_bench
+ *
+ * 같은 작업을 세 가지 할당기로 돌린다.
+ *   new/delete     std::allocator (glibc malloc)
+ *   mm::allocator  mm_resource.hpp의 상태 없는 할당기
+ *   pmr            mm::resource()를 기본 자원으로 둔 std::pmr 컨테이너.
+ *                  mm::allocator와의 차이가 가상 호출 비용이다
+ *
+ * 작업은 trace 파일이 담지 못하는 컨테이너 고유의 패턴이다. vector는 두 배씩
+ * 커지며 옛 버퍼를 버리고, map/unordered_map은 같은 크기의 노드를 끝없이 넣고
+ * 빼며, string은 작은 조각을 이어 붙이며 다시 할당한다. mm.c는 매 실행마다
+ * mem_reset_brk와 mm_init으로 새 힙에서 시작한다. 시간은 fsecs로 재고, 배수는
+ * new/delete 시간을 나눈 것이라 1보다 크면 mm.c가 빠르다. 세 할당기의 결과
+ * 체크섬이 다르면 오류다.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <functional>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mm_resource.hpp"
+extern "C" {
+#include "memlib.h"
+#include "fsecs.h"
+}
+
+/* fsecs.c가 보는 mdriver의 -v 값 */
+extern "C" int verbose;
+int verbose = 0;
+
+namespace {
+
+/* 할당기 선택. 컨테이너는 모두 기본 생성되므로 pmr은 기본 자원을 바꿔 둔다 */
+struct use_new {
+    template <class T> using alloc = std::allocator<T>;
+    static constexpr const char *name = "new/delete";
+    static void begin() {}
+    static void end() {}
+};
+
+struct use_mm {
+    template <class T> using alloc = mm::allocator<T>;
+    static constexpr const char *name = "mm::allocator";
+    static void begin() {
+        mem_reset_brk();
+        if (mm_init() < 0) {
+            fprintf(stderr, "mm_bench: mm_init failed\n");
+            exit(1);
+        }
+    }
+    static void end() {}
+};
+
+struct use_pmr {
+    template <class T> using alloc = std::pmr::polymorphic_allocator<T>;
+    static constexpr const char *name = "pmr";
+    static void begin() {
+        use_mm::begin();
+        std::pmr::set_default_resource(mm::resource());
+    }
+    static void end() { std::pmr::set_default_resource(nullptr); }
+};
+
+/* 실행마다 같은 수열이 나오도록 작업 안에서 씨앗을 정한다 */
+struct rng {
+    unsigned long s;
+    explicit rng(unsigned long seed) : s(seed) {}
+    unsigned next() {
+        s = s * 6364136223846793005UL + 1442695040888963407UL;
+        return s >> 33;
+    }
+};
+
+/* vector 16개를 번갈아 키우다가 각자 정한 길이에 닿으면 버린다 */
+template <class P>
+unsigned long vector_growth() {
+    typedef std::vector<unsigned, typename P::template alloc<unsigned>> vec;
+    vec v[16];
+    size_t limit[16];
+    unsigned long sum = 0;
+    rng r(1);
+
+    for (int i = 0; i < 16; i++)
+        limit[i] = 1 + r.next() % 65536;
+    for (unsigned i = 0; i < (1u << 21); i++) {
+        unsigned k = r.next() % 16;
+        v[k].push_back(i);
+        if (v[k].size() >= limit[k]) {
+            sum += v[k][v[k].size() / 2];
+            vec().swap(v[k]);
+            limit[k] = 1 + r.next() % 65536;
+        }
+    }
+    return sum;
+}
+
+/* 키 공간의 절반쯤이 늘 살아 있도록 있으면 지우고 없으면 넣는다 */
+template <class Map>
+unsigned long map_churn() {
+    Map m;
+    unsigned long sum = 0;
+    rng r(2);
+
+    for (int i = 0; i < 400000; i++) {
+        unsigned key = r.next() % 100000;
+        auto it = m.find(key);
+        if (it == m.end())
+            m.emplace(key, i);
+        else {
+            sum += it->second;
+            m.erase(it);
+        }
+    }
+    return sum + m.size();
+}
+
+template <class P>
+unsigned long ordered_map_churn() {
+    typedef std::pair<const unsigned, unsigned> value;
+    return map_churn<std::map<unsigned, unsigned, std::less<unsigned>,
+                              typename P::template alloc<value>>>();
+}
+
+template <class P>
+unsigned long unordered_map_churn() {
+    typedef std::pair<const unsigned, unsigned> value;
+    return map_churn<std::unordered_map<unsigned, unsigned, std::hash<unsigned>,
+                                        std::equal_to<unsigned>,
+                                        typename P::template alloc<value>>>();
+}
+
+/* 문자열 4096개에 짧은 조각을 붙이다가 정한 길이를 넘으면 새로 시작한다 */
+template <class P>
+unsigned long string_building() {
+    typedef std::basic_string<char, std::char_traits<char>,
+                              typename P::template alloc<char>> str;
+    std::vector<str, typename P::template alloc<str>> v(4096);
+    static const char text[] = "the quick brown fox jumps over the lazy dog";
+    unsigned long sum = 0;
+    rng r(3);
+
+    for (int i = 0; i < 400000; i++) {
+        str &s = v[r.next() % v.size()];
+        s.append(text, 1 + r.next() % (sizeof(text) - 1));
+        if (s.size() > 64 + r.next() % 1024) {
+            sum += s.size();
+            str().swap(s);
+        }
+    }
+    return sum;
+}
+
+struct run_t {
+    unsigned long (*work)();
+    void (*begin)();
+    void (*end)();
+    unsigned long sum;
+};
+
+void run(void *ptr) {
+    run_t *r = static_cast<run_t *>(ptr);
+    r->begin();
+    r->sum = r->work();
+    r->end();
+}
+
+/* 한 작업을 세 할당기로 재고 한 줄로 찍는다. 체크섬이 어긋나면 0을 돌려준다 */
+template <template <class> class Work>
+int bench(const char *name) {
+    run_t runs[3] = {
+        { Work<use_new>::run, use_new::begin, use_new::end, 0 },
+        { Work<use_mm>::run, use_mm::begin, use_mm::end, 0 },
+        { Work<use_pmr>::run, use_pmr::begin, use_pmr::end, 0 },
+    };
+    double secs[3];
+
+    for (int i = 0; i < 3; i++)
+        secs[i] = fsecs(run, &runs[i]);
+    printf("%-20s %13.2f %13.2f %5.2fx %13.2f %5.2fx\n", name,
+           secs[0] * 1e3, secs[1] * 1e3, secs[0] / secs[1],
+           secs[2] * 1e3, secs[0] / secs[2]);
+    if (runs[1].sum != runs[0].sum || runs[2].sum != runs[0].sum) {
+        printf("ERROR: %s gave different results per allocator\n", name);
+        return 0;
+    }
+    return 1;
+}
+
+/* bench<Work>가 할당기마다 인스턴스를 고를 수 있도록 함수를 감싼다 */
+template <class P> struct vector_work { static unsigned long run() { return vector_growth<P>(); } };
+template <class P> struct map_work { static unsigned long run() { return ordered_map_churn<P>(); } };
+template <class P> struct unordered_work { static unsigned long run() { return unordered_map_churn<P>(); } };
+template <class P> struct string_work { static unsigned long run() { return string_building<P>(); } };
+
+} // namespace
+
+int main() {
+    int ok = 1;
+
+    mem_init();
+    init_fsecs();
+    printf("\n%-20s %13s %13s %6s %13s %6s\n", "workload (ms)",
+           use_new::name, use_mm::name, "", use_pmr::name, "");
+    ok &= bench<vector_work>("vector growth");
+    ok &= bench<map_work>("map churn");
+    ok &= bench<unordered_work>("unordered_map churn");
+    ok &= bench<string_work>("string building");
+    return ok ? 0 : 1;
+}
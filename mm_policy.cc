@@ -0,0 +1,80 @@
+/*
+ * mm_policy.cc - mm_policy.hpp의 이름 붙은 인스턴스와 그 C 진입점.
+ *
+ * 앞의 세 설정은 mm_1implicit_comments.c, mm_2explicit_comments.c,
+ * mm_3segregated_comment.c의 정책을 그대로 옮긴 것이다. 원본과 다른 점은
+ * 링크가 64비트에서도 맞는 32비트 오프셋이라는 것과, 3번의 realloc 태그(RA tag)
+ * 대신 realloc_pad 여유만 남긴 것이다.
+ */
+#include "mm_policy.hpp"
+#include "mm_policy.h"
+
+namespace {
+
+using namespace mm;
+
+/* mm_1implicit_comments.c: 리스트 없이 힙을 훑는 next fit */
+struct implicit_next_fit_config {
+    typedef boundary_tags layout;
+    typedef next_fit fit;
+    typedef lifo order;
+    typedef copy_realloc realloc;
+    static constexpr unsigned bins = 0;
+    static constexpr size_t split_min = 16, tail_min = 0;
+    static constexpr size_t chunk = 1 << 12, init_chunk = 1 << 12, realloc_pad = 0;
+};
+
+/* mm_2explicit_comments.c: LIFO 리스트 하나에 first fit, 힙은 요청만큼만 늘린다 */
+struct explicit_first_fit_config {
+    typedef boundary_tags layout;
+    typedef first_fit fit;
+    typedef lifo order;
+    typedef in_place_realloc realloc;
+    static constexpr unsigned bins = 1;
+    static constexpr size_t split_min = 16, tail_min = 0;
+    static constexpr size_t chunk = 16, init_chunk = 16, realloc_pad = 0;
+};
+
+/* mm_3segregated_comment.c: 2의 거듭제곱 구간 20개, 큰 요청은 뒤쪽에서 자른다 */
+struct segregated_first_fit_config {
+    typedef boundary_tags layout;
+    typedef first_fit fit;
+    typedef lifo order;
+    typedef in_place_realloc realloc;
+    static constexpr unsigned bins = 20;
+    static constexpr size_t split_min = 24, tail_min = 100;
+    static constexpr size_t chunk = 1 << 12, init_chunk = 1 << 6, realloc_pad = 1 << 7;
+};
+
+struct implicit_best_fit_config : implicit_next_fit_config {
+    typedef best_fit fit;
+};
+
+struct explicit_best_fit_config : explicit_first_fit_config {
+    typedef best_fit fit;
+    static constexpr size_t chunk = 1 << 12;
+};
+
+struct explicit_address_fit_config : explicit_first_fit_config {
+    typedef address_ordered order;
+    static constexpr size_t chunk = 1 << 12;
+};
+
+/* 구간 안을 크기 순으로 두면 first fit이 곧 best fit이다. 할당 블록에는 풋터가 없다 */
+struct segregated_best_fit_config : segregated_first_fit_config {
+    typedef prev_alloc_bit layout;
+    typedef size_ordered order;
+    static constexpr size_t split_min = 16, tail_min = 0, realloc_pad = 0;
+};
+
+} // namespace
+
+/* name##_config로 engine 하나를 만들고 mm.h와 같은 모양의 C 함수로 내보낸다 */
+#define MM_POLICY_DEFINE(name)                                                                                         \
+    static mm::engine<name##_config> name##_engine;                                                                    \
+    extern "C" int name##_init(void) { return name##_engine.init(); }                                                  \
+    extern "C" void *name##_malloc(size_t size) { return name##_engine.malloc(size); }                                 \
+    extern "C" void name##_free(void *ptr) { name##_engine.free(ptr); }                                                \
+    extern "C" void *name##_realloc(void *ptr, size_t size) { return name##_engine.realloc(ptr, size); }
+
+MM_POLICY_VARIANTS(MM_POLICY_DEFINE)
@@ -0,0 +1,40 @@
+/*
+ * mm_policy.h - C entry points for the allocators built from mm_policy.hpp.
+ *
+ * Each variant in MM_POLICY_VARIANTS has the mm.h calling convention under
+ * its own prefix: <name>_init, <name>_malloc, <name>_free, <name>_realloc.
+ * All variants share the default memlib region, so only one of them may
+ * be in use between mem_reset_brk calls.
+ */
+#ifndef MM_POLICY_H
+#define MM_POLICY_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* X(name): one line per named instantiation in mm_policy.cc */
+#define MM_POLICY_VARIANTS(X)                                            \
+    X(implicit_next_fit)     /* mm_1implicit_comments.c */               \
+    X(explicit_first_fit)    /* mm_2explicit_comments.c */               \
+    X(segregated_first_fit)  /* mm_3segregated_comment.c */              \
+    X(implicit_best_fit)                                                 \
+    X(explicit_best_fit)                                                 \
+    X(explicit_address_fit)  /* address-ordered list, first fit */       \
+    X(segregated_best_fit)   /* size-ordered bins, no allocated footer */
+
+#define MM_POLICY_DECLARE(name)                                          \
+    extern int name##_init(void);                                        \
+    extern void *name##_malloc(size_t size);                             \
+    extern void name##_free(void *ptr);                                  \
+    extern void *name##_realloc(void *ptr, size_t size);
+
+MM_POLICY_VARIANTS(MM_POLICY_DECLARE)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MM_POLICY_H */
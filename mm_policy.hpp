@@ -0,0 +1,389 @@
+/*
+ * mm_policy.hpp - 정책을 조립해서 만드는 경계 태그 할당기 템플릿.
+ *
+ * mm_1implicit_comments.c, mm_2explicit_comments.c, mm_3segregated_comment.c는
+ * extend_heap, coalesce, place를 조금씩 다르게 되풀이한다. engine<Config>는 그
+ * 공통 뼈대 하나에 Config가 고른 정책을 컴파일 때 끼워 넣는다.
+ *
+ *   layout      헤더 배치. boundary_tags는 모든 블록에 헤더와 풋터를 두고,
+ *               prev_alloc_bit는 mm.c처럼 풋터를 가용 블록에만 둔다.
+ *   bins        가용 리스트 수. 0이면 리스트 없이 힙을 훑고(implicit),
+ *               1이면 명시적 리스트 하나, 그 이상이면 2의 거듭제곱 크기 구간.
+ *   fit         first_fit, next_fit(bins가 0일 때만), best_fit.
+ *   order       리스트 안의 순서. lifo, address_ordered, size_ordered.
+ *   split_min   떼어 낸 나머지가 이보다 작으면 나누지 않고 통째로 준다.
+ *   tail_min    0이 아니면 이 크기 이상의 요청은 가용 블록의 뒤쪽에서 잘라 준다.
+ *   chunk       찾지 못했을 때 힙을 늘리는 최소 크기. init_chunk는 mm_init 때.
+ *   realloc     copy는 늘 새로 할당해서 복사하고, in_place는 줄이거나 다음
+ *               가용 블록/힙 꼭대기로 늘린다. realloc_pad만큼 여유를 더 잡는다.
+ *
+ * 모든 선택은 if constexpr와 정책 클래스의 인라인 함수로 풀리므로, 인스턴스마다
+ * 실행 중에 정책을 묻는 분기가 없는 코드가 나온다. 가용 리스트 링크는 mm.c처럼
+ * mem_heap_lo로부터의 32비트 오프셋이고 0이 NULL이다. 힙은 기본 memlib 영역
+ * 하나를 쓰므로 한 번에 한 인스턴스만 mm_init해서 쓸 수 있다.
+ */
+#ifndef MM_POLICY_HPP
+#define MM_POLICY_HPP
+
+#include <stddef.h>
+#include <string.h>
+#include <type_traits>
+
+#include "config.h"
+extern "C" {
+#include "memlib.h"
+}
+
+namespace mm {
+
+typedef unsigned int word_t;
+
+/* 블록 포인터(bp)는 payload를 가리키고, 헤더는 그 앞 4B에 있다 */
+static inline word_t &word(char *p) { return *(word_t *)p; }
+static inline size_t block_size(char *bp) { return word(bp - 4) & ~(word_t)7; }
+static inline bool block_alloc(char *bp) { return word(bp - 4) & 1; }
+static inline char *next_block(char *bp) { return bp + block_size(bp); }
+/* 앞 블록의 풋터로 앞 블록을 찾는다. 앞 블록이 가용일 때는 어느 배치든 풋터가 있다 */
+static inline char *prev_block(char *bp) { return bp - (word(bp - 8) & ~(word_t)7); }
+
+/* 헤더 배치 정책 */
+struct boundary_tags {
+    static constexpr size_t overhead = 8; // 헤더 + 풋터
+    static void set_alloc(char *bp, size_t size) {
+        word(bp - 4) = size | 1;
+        word(bp + size - 8) = size | 1;
+    }
+    static void set_free(char *bp, size_t size) {
+        word(bp - 4) = size;
+        word(bp + size - 8) = size;
+    }
+    static bool prev_alloc(char *bp) { return word(bp - 8) & 1; }
+};
+
+struct prev_alloc_bit {
+    static constexpr size_t overhead = 4; // 헤더만. 헤더의 1번 비트가 앞 블록의 할당 여부
+    static void set_alloc(char *bp, size_t size) {
+        word(bp - 4) = size | 1 | (word(bp - 4) & 2);
+        word(bp + size - 4) |= 2;
+    }
+    static void set_free(char *bp, size_t size) {
+        word(bp - 4) = size | (word(bp - 4) & 2);
+        word(bp + size - 8) = size;
+        word(bp + size - 4) &= ~(word_t)2;
+    }
+    static bool prev_alloc(char *bp) { return word(bp - 4) & 2; }
+};
+
+/* 맞춤 정책 */
+struct first_fit {};
+struct next_fit {};
+struct best_fit {};
+
+/* 리스트 순서 정책. sorted가 거짓이면 앞에 넣는다 */
+struct lifo {
+    static constexpr bool sorted = false;
+    static constexpr bool by_size = false;
+    static bool before(char *, char *) { return false; }
+};
+struct address_ordered {
+    static constexpr bool sorted = true;
+    static constexpr bool by_size = false;
+    static bool before(char *a, char *b) { return a < b; }
+};
+struct size_ordered {
+    static constexpr bool sorted = true;
+    static constexpr bool by_size = true;
+    static bool before(char *a, char *b) {
+        return block_size(a) < block_size(b) || (block_size(a) == block_size(b) && a < b);
+    }
+};
+
+/* realloc 정책 */
+struct copy_realloc {};
+struct in_place_realloc {};
+
+template <class Config>
+class engine {
+    typedef typename Config::layout L;
+    typedef typename Config::fit F;
+    typedef typename Config::order O;
+
+    static constexpr unsigned BINS = Config::bins;
+    static constexpr size_t ALIGN = ALIGNMENT;
+    static constexpr size_t MIN_BLOCK = (16 + ALIGN - 1) & ~(ALIGN - 1);
+    static constexpr size_t MAX_REQUEST = (size_t)1 << 30;
+
+    static_assert(BINS <= 64, "bin bitmap holds 64 bins");
+    static_assert(BINS == 0 || !std::is_same_v<F, next_fit>, "next_fit walks the heap and needs bins = 0");
+    static_assert(Config::split_min >= MIN_BLOCK, "split_min is smaller than a free block");
+
+    char *lo_;                          // mem_heap_lo, 오프셋의 기준
+    char *first_;                       // 프롤로그 다음 첫 블록
+    char *rover_;                       // next_fit이 다음에 찾기 시작할 블록
+    word_t heads_[BINS ? BINS : 1];     // 구간별 리스트의 첫 블록 오프셋
+    unsigned long long bitmap_;         // i번 비트: heads_[i]가 비어 있지 않음
+
+    /* 가용 블록 안의 링크: bp에 이전, bp + 4에 다음 */
+    word_t off(char *bp) { return bp ? (word_t)(bp - lo_) : 0; }
+    char *ptr(word_t o) { return o ? lo_ + o : nullptr; }
+    char *pred(char *bp) { return ptr(word(bp)); }
+    char *succ(char *bp) { return ptr(word(bp + 4)); }
+
+    static size_t adjust(size_t size) {
+        size_t asize = (size + L::overhead + ALIGN - 1) & ~(ALIGN - 1);
+        return asize < MIN_BLOCK ? MIN_BLOCK : asize;
+    }
+
+    /* 구간 0은 [MIN_BLOCK, 2 * MIN_BLOCK), 그 뒤로 2배씩, 마지막 구간은 나머지 전부 */
+    static unsigned bin_of(size_t size) {
+        if constexpr (BINS <= 1) {
+            return 0;
+        } else {
+            unsigned b = (63 - __builtin_clzll(size)) - (63 - __builtin_clzll(MIN_BLOCK));
+            return b < BINS - 1 ? b : BINS - 1;
+        }
+    }
+
+    void insert(char *bp) {
+        if constexpr (BINS > 0) {
+            unsigned b = bin_of(block_size(bp));
+            char *p = nullptr, *n = ptr(heads_[b]);
+            if constexpr (O::sorted) {
+                while (n != nullptr && O::before(n, bp)) {
+                    p = n;
+                    n = succ(n);
+                }
+            }
+            word(bp) = off(p);
+            word(bp + 4) = off(n);
+            if (p != nullptr)
+                word(p + 4) = off(bp);
+            else
+                heads_[b] = off(bp);
+            if (n != nullptr)
+                word(n) = off(bp);
+            bitmap_ |= 1ull << b;
+        }
+    }
+
+    void remove(char *bp) {
+        if constexpr (BINS > 0) {
+            char *p = pred(bp), *n = succ(bp);
+            if (p != nullptr) {
+                word(p + 4) = off(n);
+            } else {
+                unsigned b = bin_of(block_size(bp));
+                heads_[b] = off(n);
+                if (n == nullptr)
+                    bitmap_ &= ~(1ull << b);
+            }
+            if (n != nullptr)
+                word(n) = off(p);
+        }
+    }
+
+    /* 헤더가 가용으로 바뀐 bp를 이웃 가용 블록과 합쳐 리스트에 넣는다 */
+    char *coalesce(char *bp) {
+        size_t size = block_size(bp);
+        char *n = bp + size;
+        if (!block_alloc(n)) {
+            remove(n);
+            size += block_size(n);
+        }
+        if (!L::prev_alloc(bp)) {
+            bp = prev_block(bp);
+            remove(bp);
+            size += block_size(bp);
+        }
+        L::set_free(bp, size);
+        insert(bp);
+        if constexpr (std::is_same_v<F, next_fit>)
+            rover_ = bp; // 합친 블록 안을 가리키지 않게 원본처럼 합친 블록으로 옮긴다
+        return bp;
+    }
+
+    char *extend(size_t bytes) {
+        char *bp;
+        if (bytes > MAX_REQUEST || (bp = (char *)mem_sbrk((int)bytes)) == (char *)-1)
+            return nullptr;
+        // 옛 에필로그 헤더가 새 블록의 헤더가 된다
+        word(bp + bytes - 4) = 1;
+        L::set_free(bp, bytes);
+        return coalesce(bp);
+    }
+
+    /* 리스트 하나에서 asize 이상인 블록을 찾는다. best_fit이면 가장 작은 것 */
+    char *search(char *n, size_t asize) {
+        char *best = nullptr;
+        for (; n != nullptr; n = succ(n)) {
+            size_t s = block_size(n);
+            if (s < asize)
+                continue;
+            if constexpr (!std::is_same_v<F, best_fit> || O::by_size)
+                return n;
+            if (best == nullptr || s < block_size(best))
+                best = n;
+            if (s == asize)
+                break;
+        }
+        return best;
+    }
+
+    char *find_fit(size_t asize) {
+        if constexpr (BINS == 0) {
+            char *bp, *best = nullptr;
+            if constexpr (std::is_same_v<F, next_fit>) {
+                // 원본처럼 rover부터 끝까지만 찾고, 없으면 처음으로 되돌린 뒤 힙을 늘린다
+                for (bp = rover_; block_size(bp) > 0; bp = next_block(bp))
+                    if (!block_alloc(bp) && block_size(bp) >= asize)
+                        return rover_ = bp;
+                rover_ = first_;
+                return nullptr;
+            }
+            for (bp = first_; block_size(bp) > 0; bp = next_block(bp)) {
+                if (block_alloc(bp) || block_size(bp) < asize)
+                    continue;
+                if constexpr (!std::is_same_v<F, best_fit>)
+                    return bp;
+                if (best == nullptr || block_size(bp) < block_size(best))
+                    best = bp;
+                if (block_size(bp) == asize)
+                    break;
+            }
+            return best;
+        } else {
+            unsigned b = bin_of(asize);
+            char *bp = search(ptr(heads_[b]), asize);
+            if (bp != nullptr || b + 1 >= BINS)
+                return bp;
+            // 위 구간의 블록은 모두 asize보다 크다
+            unsigned long long map = bitmap_ & (~0ull << (b + 1));
+            if (map == 0)
+                return nullptr;
+            return search(ptr(heads_[__builtin_ctzll(map)]), asize);
+        }
+    }
+
+    /* 가용 블록 bp에서 asize를 잘라 할당하고 할당 블록을 돌려준다 */
+    char *place(char *bp, size_t asize) {
+        size_t csize = block_size(bp), rem = csize - asize;
+        remove(bp);
+        if (rem < Config::split_min) {
+            L::set_alloc(bp, csize);
+            return bp;
+        }
+        if (Config::tail_min != 0 && asize >= Config::tail_min) {
+            L::set_free(bp, rem);
+            insert(bp);
+            L::set_alloc(bp + rem, asize);
+            return bp + rem;
+        }
+        L::set_alloc(bp, asize);
+        L::set_free(bp + asize, rem);
+        insert(bp + asize);
+        return bp;
+    }
+
+    char *alloc(size_t asize) {
+        char *bp = find_fit(asize);
+        if (bp == nullptr && (bp = extend(asize > Config::chunk ? asize : Config::chunk)) == nullptr)
+            return nullptr;
+        return place(bp, asize);
+    }
+
+    /* 할당 블록 bp를 asize로 자르고 꼬리를 돌려준다 */
+    void shrink(char *bp, size_t asize) {
+        size_t csize = block_size(bp);
+        if (csize - asize < Config::split_min)
+            return;
+        L::set_alloc(bp, asize);
+        L::set_free(bp + asize, csize - asize);
+        coalesce(bp + asize);
+    }
+
+public:
+    int init() {
+        lo_ = (char *)mem_heap_lo();
+        if (mem_sbrk(2 * ALIGN) == (void *)-1)
+            return -1;
+        // 패딩, 프롤로그(크기 ALIGN, 할당), 에필로그
+        first_ = lo_ + 2 * ALIGN;
+        word(lo_ + ALIGN - 4) = ALIGN | 1;
+        word(first_ - 8) = ALIGN | 1;
+        word(first_ - 4) = 1 | 2;
+        rover_ = first_;
+        memset(heads_, 0, sizeof(heads_));
+        bitmap_ = 0;
+        if (Config::init_chunk != 0 && extend(Config::init_chunk) == nullptr)
+            return -1;
+        return 0;
+    }
+
+    void *malloc(size_t size) {
+        if (size == 0 || size > MAX_REQUEST)
+            return nullptr;
+        return alloc(adjust(size));
+    }
+
+    void free(void *ptr) {
+        char *bp = (char *)ptr;
+        if (bp == nullptr)
+            return;
+        L::set_free(bp, block_size(bp));
+        coalesce(bp);
+    }
+
+    void *realloc(void *ptr, size_t size) {
+        char *bp = (char *)ptr, *np;
+        size_t asize, csize, payload;
+
+        if (bp == nullptr)
+            return malloc(size);
+        if (size == 0) {
+            free(bp);
+            return nullptr;
+        }
+        if (size > MAX_REQUEST)
+            return nullptr;
+        asize = adjust(size) + Config::realloc_pad;
+        csize = block_size(bp);
+        if constexpr (std::is_same_v<typename Config::realloc, in_place_realloc>) {
+            if (adjust(size) <= csize) {
+                shrink(bp, asize < csize ? asize : csize);
+                return bp;
+            }
+            char *n = next_block(bp);
+            // 힙 꼭대기 블록이면 모자란 만큼 늘려서 다음 가용 블록으로 만든다
+            if (block_size(n) == 0 || (!block_alloc(n) && block_size(next_block(n)) == 0)) {
+                size_t have = csize + (block_alloc(n) ? 0 : block_size(n));
+                if (have < asize && extend(asize - have > Config::chunk ? asize - have : Config::chunk) == nullptr)
+                    return nullptr;
+            }
+            if (!block_alloc(n) && csize + block_size(n) >= asize) {
+                remove(n);
+                if constexpr (std::is_same_v<F, next_fit>)
+                    if (rover_ == n)
+                        rover_ = bp;
+                size_t total = csize + block_size(n);
+                if (total - asize >= Config::split_min) {
+                    L::set_alloc(bp, asize);
+                    L::set_free(bp + asize, total - asize);
+                    insert(bp + asize);
+                } else {
+                    L::set_alloc(bp, total);
+                }
+                return bp;
+            }
+        }
+        if ((np = alloc(asize)) == nullptr)
+            return nullptr;
+        payload = csize - L::overhead;
+        memcpy(np, bp, payload < size ? payload : size);
+        free(bp);
+        return np;
+    }
+};
+
+} // namespace mm
+
+#endif /* MM_POLICY_HPP */
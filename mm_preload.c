@@ -0,0 +1,256 @@
+/*
+ * mm_preload.c - Run mm.c as the process allocator (libmm.so).
+ *
+ *     LD_PRELOAD=./libmm.so sort big.txt
+ *
+ * The library exports the libc allocation entry points on top of the
+ * thread-safe mm.c, over a memlib heap reserved as one large mapping
+ * (MAX_HEAP). Every entry point that can hand out memory is replaced,
+ * so free never sees a pointer from the libc heap.
+ *
+ * Nothing runs before the first call: the loader, libc and other
+ * preloaded libraries may call malloc before any constructor runs, and
+ * a dlsym-based interposer may call calloc from inside its own setup.
+ * The first call initializes memlib and mm.c. Any request the
+ * initializing thread makes while that is under way (memlib and mm.c
+ * do not call malloc, so this is only a safety net) is served from a
+ * small static arena whose blocks are never reused. Other threads wait.
+ *
+ * Environment, read once at initialization:
+ *     MM_HUGEPAGES=1      back the heap with transparent huge pages
+ *                         (the default is base pages, which keeps RSS
+ *                         comparable with glibc)
+ *     MM_GUARD_SAMPLE=N   put about 1 in N requests before a guard page
+ *     MM_CHECK_HEAP=1|2   check the heap after every change
+ */
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "config.h"
+
+#define EXPORT __attribute__((visibility("default")))
+
+/* Bootstrap arena for requests made while initializing */
+#define BOOT_SIZE (64 * 1024)
+#define BOOT_HDR  ALIGNMENT     /* each block is preceded by its size */
+
+/* Initialization state */
+#define INIT_NONE    0
+#define INIT_RUNNING 1
+#define INIT_DONE    2
+
+static int init_state = INIT_NONE;
+static __thread int initializing;   /* set in the thread running mm_init */
+static char boot_arena[BOOT_SIZE] __attribute__((aligned(64)));
+static size_t boot_used;
+
+/*
+ * boot_alloc - carve size bytes aligned to align out of the bootstrap
+ *     arena. Only the initializing thread gets here, so no lock.
+ */
+static void *boot_alloc(size_t size, size_t align)
+{
+    size_t start;
+    char *p;
+
+    if (align < ALIGNMENT)
+	align = ALIGNMENT;
+    start = (boot_used + BOOT_HDR + align - 1) & ~(align - 1);
+    if (size > BOOT_SIZE || start + size > BOOT_SIZE) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    p = boot_arena + start;
+    *(size_t *)(p - sizeof(size_t)) = size;
+    boot_used = start + size;
+    return p;
+}
+
+static int is_boot(void *ptr)
+{
+    return (char *)ptr >= boot_arena && (char *)ptr < boot_arena + BOOT_SIZE;
+}
+
+static size_t boot_size(void *ptr)
+{
+    return *(size_t *)((char *)ptr - sizeof(size_t));
+}
+
+static int env_int(const char *name)
+{
+    char *s = getenv(name);
+    return s != NULL ? atoi(s) : 0;
+}
+
+/*
+ * preload_init - set up memlib and mm.c once. Returns 1 when mm.c is
+ *     ready, 0 when the caller is the initializing thread itself and
+ *     must use the bootstrap arena.
+ */
+static int preload_init(void)
+{
+    int state = __atomic_load_n(&init_state, __ATOMIC_ACQUIRE);
+    int none = INIT_NONE;
+
+    if (state == INIT_DONE)
+	return 1;
+    if (initializing)
+	return 0;
+    if (__atomic_compare_exchange_n(&init_state, &none, INIT_RUNNING, 0,
+				    __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+	initializing = 1;
+	mem_set_pages(env_int("MM_HUGEPAGES") ? MEM_PAGES_THP : MEM_PAGES_SMALL);
+	mem_init();
+	if (mm_init() < 0)
+	    abort();
+	mm_mallopt(MM_GUARD_SAMPLE, env_int("MM_GUARD_SAMPLE"));
+	mm_mallopt(MM_CHECK_HEAP, env_int("MM_CHECK_HEAP"));
+	initializing = 0;
+	__atomic_store_n(&init_state, INIT_DONE, __ATOMIC_RELEASE);
+	return 1;
+    }
+    while (__atomic_load_n(&init_state, __ATOMIC_ACQUIRE) != INIT_DONE)
+	sched_yield();
+    return 1;
+}
+
+/* Sizes libc would reject before allocating anything */
+static int too_big(size_t size)
+{
+    if (size > PTRDIFF_MAX) {
+	errno = ENOMEM;
+	return 1;
+    }
+    return 0;
+}
+
+/* The C library allocators set errno when they return NULL */
+static void *nomem(void *p)
+{
+    if (p == NULL)
+	errno = ENOMEM;
+    return p;
+}
+
+EXPORT void *malloc(size_t size)
+{
+    if (too_big(size))
+	return NULL;
+    if (!preload_init())
+	return boot_alloc(size, ALIGNMENT);
+    /* malloc(0) returns a unique pointer, as glibc does */
+    return nomem(mm_malloc(size != 0 ? size : 1));
+}
+
+EXPORT void free(void *ptr)
+{
+    if (ptr == NULL || is_boot(ptr))
+	return;
+    mm_free(ptr);
+}
+
+EXPORT void *calloc(size_t nmemb, size_t size)
+{
+    size_t bytes;
+
+    if (__builtin_mul_overflow(nmemb, size, &bytes) || too_big(bytes)) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    if (!preload_init())
+	return boot_alloc(bytes, ALIGNMENT); /* the arena is zeroed */
+    if (bytes == 0)
+	return nomem(mm_calloc(1, 1));
+    return nomem(mm_calloc(nmemb, size));
+}
+
+EXPORT void *realloc(void *ptr, size_t size)
+{
+    void *p;
+
+    if (too_big(size))
+	return NULL;
+    if (ptr == NULL)
+	return malloc(size);
+    if (!is_boot(ptr))
+	return size == 0 ? (mm_free(ptr), NULL) : nomem(mm_realloc(ptr, size));
+    /* Bootstrap blocks move to the real heap and are never reused */
+    if ((p = malloc(size)) != NULL)
+	memcpy(p, ptr, boot_size(ptr) < size ? boot_size(ptr) : size);
+    return p;
+}
+
+EXPORT void *reallocarray(void *ptr, size_t nmemb, size_t size)
+{
+    size_t bytes;
+
+    if (__builtin_mul_overflow(nmemb, size, &bytes)) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    return realloc(ptr, bytes);
+}
+
+EXPORT int posix_memalign(void **memptr, size_t align, size_t size)
+{
+    void *p;
+
+    if (align == 0 || align % sizeof(void *) != 0 || (align & (align - 1)) != 0)
+	return EINVAL;
+    if (size > PTRDIFF_MAX)
+	return ENOMEM;
+    if (!preload_init())
+	p = boot_alloc(size, align);
+    else
+	p = mm_memalign(align, size != 0 ? size : 1);
+    if (p == NULL)
+	return ENOMEM;
+    *memptr = p;
+    return 0;
+}
+
+EXPORT void *memalign(size_t align, size_t size)
+{
+    if (align == 0 || (align & (align - 1)) != 0) {
+	errno = EINVAL;
+	return NULL;
+    }
+    if (too_big(size))
+	return NULL;
+    if (!preload_init())
+	return boot_alloc(size, align);
+    return nomem(mm_memalign(align, size != 0 ? size : 1));
+}
+
+EXPORT void *aligned_alloc(size_t align, size_t size)
+{
+    return memalign(align, size);
+}
+
+EXPORT void *valloc(size_t size)
+{
+    return memalign(mem_pagesize(), size);
+}
+
+EXPORT void *pvalloc(size_t size)
+{
+    size_t page = mem_pagesize();
+
+    if (too_big(size))
+	return NULL;
+    return memalign(page, (size + page - 1) & ~(page - 1));
+}
+
+EXPORT size_t malloc_usable_size(void *ptr)
+{
+    if (ptr == NULL)
+	return 0;
+    if (is_boot(ptr))
+	return boot_size(ptr);
+    return mm_usable_size(ptr);
+}
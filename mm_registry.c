@@ -0,0 +1,30 @@
+/*
+ * mm_registry.c - Table of the allocators linked into mdriver.
+ */
+#include <string.h>
+
+#include "mm.h"
+#include "mm_policy.h"
+#include "mm_registry.h"
+
+#define MM_POLICY_ENTRY(name) \
+    {#name, name##_init, name##_malloc, name##_free, name##_realloc, NULL, NULL},
+
+const mm_allocator_t mm_allocators[] = {
+    {"mm", mm_init, mm_malloc, mm_free, mm_realloc, mm_usable_size, mm_checkheap},
+    MM_POLICY_VARIANTS(MM_POLICY_ENTRY)
+    {NULL, NULL, NULL, NULL, NULL, NULL, NULL}
+};
+
+/* 
+ * mm_allocator_find - Return the allocator called name, or NULL
+ */
+const mm_allocator_t *mm_allocator_find(const char *name)
+{
+    const mm_allocator_t *a;
+
+    for (a = mm_allocators; a->name != NULL; a++)
+	if (strcmp(a->name, name) == 0)
+	    return a;
+    return NULL;
+}
@@ -0,0 +1,29 @@
+/*
+ * mm_registry.h - Table of the allocators linked into mdriver.
+ *
+ * Each entry points at one allocator's entry points, all with the mm.h
+ * calling convention. Entry 0 is mm.c itself; the rest are the variants
+ * from mm_policy.h. Optional entry points are NULL when the allocator
+ * does not provide them.
+ */
+#ifndef MM_REGISTRY_H
+#define MM_REGISTRY_H
+
+#include <stddef.h>
+
+typedef struct {
+    const char *name;
+    int (*init)(void);
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    void *(*realloc)(void *ptr, size_t size);
+    size_t (*usable_size)(void *ptr); /* optional */
+    int (*checkheap)(int verbose);    /* optional */
+} mm_allocator_t;
+
+/* NULL-terminated; mm_allocators[0] is mm.c */
+extern const mm_allocator_t mm_allocators[];
+
+const mm_allocator_t *mm_allocator_find(const char *name);
+
+#endif /* MM_REGISTRY_H */
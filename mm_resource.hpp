@@ -0,0 +1,109 @@
+/*
+ * mm_resource.hpp - C++ 컨테이너가 mm.c에서 메모리를 받게 하는 어댑터.
+ *
+ *   mm::memory_resource  std::pmr::memory_resource. mm::resource()가 돌려주는
+ *                        하나를 std::pmr 컨테이너나 set_default_resource에 넘긴다.
+ *   mm::allocator<T>     상태 없는 표준 할당기. std::map<K, V, std::less<K>,
+ *                        mm::allocator<std::pair<const K, V>>>처럼 쓴다.
+ *
+ * 컨테이너는 해제할 때 크기와 정렬을 다시 알려 주므로, ALIGNMENT 이하 정렬은
+ * mm_malloc/mm_free_sized로 보낸다. 슬랩 칸이면 크기만으로 클래스가 정해져서
+ * 런 헤더를 읽지 않는다. 더 큰 정렬은 mm_memalign으로 받고 mm_free로 돌려준다
+ * (mm_free_sized는 memalign 블록에 쓸 수 없다). 0바이트 요청은 1바이트로 받는다.
+ *
+ * mem_init과 mm_init 뒤에만 쓸 수 있고, mm.c를 MM_THREAD_SAFE로 빌드하지 않았으면
+ * 한 스레드에서만 써야 한다. 메모리가 모자라면 std::bad_alloc을 던지고,
+ * -fno-exceptions로 빌드하면 abort한다.
+ */
+#ifndef MM_RESOURCE_HPP
+#define MM_RESOURCE_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <memory_resource>
+#include <new>
+
+#include "config.h"
+extern "C" {
+#include "mm.h"
+}
+
+namespace mm {
+
+namespace detail {
+
+[[noreturn]] inline void out_of_memory() {
+#if __cpp_exceptions
+    throw std::bad_alloc();
+#else
+    abort();
+#endif
+}
+
+inline void *allocate(size_t bytes, size_t align) {
+    void *p;
+    if (bytes == 0)
+        bytes = 1;
+    p = align <= ALIGNMENT ? mm_malloc(bytes) : mm_memalign(align, bytes);
+    if (p == NULL)
+        out_of_memory();
+    return p;
+}
+
+inline void deallocate(void *p, size_t bytes, size_t align) {
+    if (align <= ALIGNMENT)
+        mm_free_sized(p, bytes != 0 ? bytes : 1);
+    else
+        mm_free(p);
+}
+
+} // namespace detail
+
+class memory_resource : public std::pmr::memory_resource {
+protected:
+    void *do_allocate(size_t bytes, size_t align) override {
+        return detail::allocate(bytes, align);
+    }
+    void do_deallocate(void *p, size_t bytes, size_t align) override {
+        detail::deallocate(p, bytes, align);
+    }
+    /* 힙은 하나뿐이라 같은 객체인지만 본다. RTTI 없이도 빌드된다 */
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+        return this == &other;
+    }
+};
+
+/* 프로그램 전체가 나눠 쓰는 mm::memory_resource */
+inline memory_resource *resource() noexcept {
+    static memory_resource r;
+    return &r;
+}
+
+template <class T>
+struct allocator {
+    typedef T value_type;
+
+    allocator() noexcept {}
+    template <class U>
+    allocator(const allocator<U> &) noexcept {}
+
+    T *allocate(size_t n) {
+        if (n > SIZE_MAX / sizeof(T))
+            detail::out_of_memory();
+        return static_cast<T *>(detail::allocate(n * sizeof(T), alignof(T)));
+    }
+    void deallocate(T *p, size_t n) noexcept {
+        detail::deallocate(p, n * sizeof(T), alignof(T));
+    }
+};
+
+/* 상태가 없으니 어느 두 인스턴스든 서로의 블록을 해제할 수 있다 */
+template <class T, class U>
+bool operator==(const allocator<T> &, const allocator<U> &) noexcept { return true; }
+template <class T, class U>
+bool operator!=(const allocator<T> &, const allocator<U> &) noexcept { return false; }
+
+} // namespace mm
+
+#endif /* MM_RESOURCE_HPP */
@@ -0,0 +1,734 @@
+/*
+ * mm_trace.c - Record the allocations of a live process as a trace
+ *     file for mdriver (libmmtrace.so).
+ *
+ *     LD_PRELOAD=./libmmtrace.so MMTRACE_FILE=sort.rep sort big.txt
+ *     ./mdriver -f sort.rep
+ *
+ * The library wraps the libc allocation entry points, forwards each call
+ * to the next definition (glibc, or libmm.so when it is preloaded after
+ * this one) and records it in the format read_trace in mdriver.c reads:
+ * every block gets a new id when it is allocated, realloc keeps the id,
+ * and pointers never appear in the trace. Allocations that fail, frees
+ * of pointers that were not traced (blocks allocated before tracing
+ * started, or by code that calls glibc directly) and blocks larger than
+ * mdriver can replay are left out. malloc(0) is recorded as a 1-byte
+ * request, because mdriver rejects 0-byte blocks.
+ *
+ * Recording is split so the traced threads never block on I/O:
+ *   - Each thread appends fixed-size events to its own single-producer
+ *     ring. An event carries a sequence number from one global counter,
+ *     taken after the call for requests that hand out memory and before
+ *     the call for requests that give it back, so a block is always
+ *     freed in sequence order before its address is handed out again.
+ *     realloc records one event on each side of the call.
+ *   - A background thread merges the rings by sequence number, assigns
+ *     the ids and writes the trace. It only merges up to the oldest
+ *     sequence number some thread may still be about to publish.
+ * A thread only waits when its ring is full.
+ *
+ * The header (suggested heap size = peak live bytes, ids, ops, weight)
+ * is only known at exit. It is written as fixed-width fields that the
+ * exit handler overwrites in place, so the body streams straight to the
+ * file. When the file name ends in .gz the header is a gzip member of
+ * its own (a stored block, also overwritten in place) followed by the
+ * compressed body as a second member; zcat gives back the plain trace.
+ *
+ * Environment, read once at startup:
+ *     MMTRACE_FILE=path   the trace file (default mmtrace.%p.rep); %p
+ *                         becomes the process id, which keeps the
+ *                         programs a traced program runs from writing
+ *                         over its trace
+ *
+ * Only the process that loads the library is traced; a forked child
+ * runs untraced. A process killed before exit leaves a trace whose
+ * header still holds zeros.
+ */
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <zlib.h>
+
+#define EXPORT __attribute__((visibility("default")))
+
+/* Requests and the trace line each one turns into */
+#define OP_MALLOC        0   /* a <id> <size> */
+#define OP_CALLOC        1   /* c <id> <nmemb> <size> */
+#define OP_MEMALIGN      2   /* m <id> <align> <size> */
+#define OP_FREE          3   /* f <id> */
+#define OP_REALLOC_BEGIN 4   /* (takes the old block out of the table) */
+#define OP_REALLOC_END   5   /* r <id> <size>, f <id> or a <id> <size> */
+
+#define RING_SIZE  4096               /* events per thread, a power of 2 */
+#define OUT_SIZE   (64 * 1024)        /* output buffer of the writer */
+#define BOOT_SIZE  (16 * 1024)        /* for dlsym before the real calls */
+#define HDR_FIELD  10                 /* digits per header field */
+#define HDR_LEN    (4 * (HDR_FIELD + 1))
+#define NO_SEQ     UINT64_MAX
+#define MAX_BLOCK  INT_MAX            /* mdriver keeps block sizes in ints */
+
+typedef struct {
+    uint64_t seq;
+    void *ptr;                 /* the block handed out or given back */
+    void *old;                 /* OP_REALLOC_END: the block passed in */
+    size_t size;
+    size_t arg;                /* nmemb for calloc, align for memalign */
+    int op;
+} event_t;
+
+/*
+ * One ring per thread. The owning thread moves tail and the writer
+ * moves head; inflight is a lower bound on the sequence number the owner
+ * is about to publish, NO_SEQ when it is not publishing.
+ */
+typedef struct ring {
+    struct ring *next;         /* every ring ever made, never unlinked */
+    int owner;                 /* 1 while a thread uses the ring */
+    uint64_t inflight;
+    size_t head __attribute__((aligned(64)));
+    size_t tail __attribute__((aligned(64)));
+    /* writer state: the block between OP_REALLOC_BEGIN and _END */
+    unsigned moving_id;
+    size_t moving_size;
+    int moving;
+    event_t ev[RING_SIZE];
+} ring_t;
+
+/* Block table of the writer: live pointer -> id and requested size */
+typedef struct {
+    void *ptr;
+    unsigned id;
+    size_t size;
+} slot_t;
+
+static void *(*real_malloc)(size_t);
+static void (*real_free)(void *);
+static void *(*real_calloc)(size_t, size_t);
+static void *(*real_realloc)(void *, size_t);
+static int (*real_posix_memalign)(void **, size_t, size_t);
+static void *(*real_memalign)(size_t, size_t);
+
+static int tracing;                  /* set between startup and exit */
+static int stopping;                 /* tells the writer to finish */
+static uint64_t next_seq;
+static ring_t *rings;
+static pthread_key_t ring_key;
+static pthread_t writer;
+
+static __thread ring_t *self;
+static __thread int in_tracer;       /* our own calls are not traced */
+
+static char boot_arena[BOOT_SIZE] __attribute__((aligned(64)));
+static size_t boot_used;
+
+/* Writer state */
+static int out_fd = -1;
+static gzFile out_gz;
+static char out_buf[OUT_SIZE];
+static size_t out_len;
+static slot_t *table;
+static size_t table_mask, table_used;
+static unsigned num_ids, num_ops;
+static size_t live_bytes, peak_bytes;
+
+/*
+ * boot_alloc - serve the requests made while looking up the real
+ *     functions. The blocks are never freed.
+ */
+static void *boot_alloc(size_t size)
+{
+    size_t start;
+
+    if (size > BOOT_SIZE)
+	return NULL;
+    start = __atomic_fetch_add(&boot_used, (size + 15) & ~(size_t)15, __ATOMIC_RELAXED);
+    if (start + size > BOOT_SIZE)
+	return NULL;
+    return boot_arena + start;
+}
+
+static int is_boot(void *ptr)
+{
+    return (char *)ptr >= boot_arena && (char *)ptr < boot_arena + BOOT_SIZE;
+}
+
+/* resolve - find the definitions this library hides */
+static void resolve(void)
+{
+    in_tracer++;
+    /* malloc last: until it is set, dlsym's own requests use the arena */
+    real_free = dlsym(RTLD_NEXT, "free");
+    real_calloc = dlsym(RTLD_NEXT, "calloc");
+    real_realloc = dlsym(RTLD_NEXT, "realloc");
+    real_posix_memalign = dlsym(RTLD_NEXT, "posix_memalign");
+    real_memalign = dlsym(RTLD_NEXT, "memalign");
+    real_malloc = dlsym(RTLD_NEXT, "malloc");
+    in_tracer--;
+    if (real_malloc == NULL || real_free == NULL || real_calloc == NULL ||
+	real_realloc == NULL || real_posix_memalign == NULL ||
+	real_memalign == NULL)
+	abort();
+}
+
+/*********************************
+ * Producer side (traced threads)
+ *********************************/
+
+/* Runs in the exiting thread; a later request there takes a ring again */
+static void ring_release(void *ring)
+{
+    self = NULL;
+    __atomic_store_n(&((ring_t *)ring)->owner, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * ring_acquire - give the calling thread a ring: one left by a thread
+ *     that exited, or a new one. A reused ring keeps its unwritten events,
+ *     which are older than anything the new owner records.
+ */
+static ring_t *ring_acquire(void)
+{
+    ring_t *r;
+    int free_ring;
+
+    for (r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r != NULL; r = r->next) {
+	free_ring = 0;
+	if (__atomic_compare_exchange_n(&r->owner, &free_ring, 1, 0,
+					__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+	    break;
+    }
+    if (r == NULL) {
+	r = mmap(NULL, sizeof(ring_t), PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (r == MAP_FAILED)
+	    return NULL;
+	r->owner = 1;
+	r->inflight = NO_SEQ;
+	r->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&rings, &r->next, r, 0,
+					    __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+	    ;
+    }
+    /* pthread_setspecific may allocate */
+    in_tracer++;
+    pthread_setspecific(ring_key, r);
+    in_tracer--;
+    return r;
+}
+
+/*
+ * record - publish one event in the calling thread's ring. The slot is
+ *     claimed before the sequence number is taken, so a thread never
+ *     holds up the writer while it waits for room.
+ */
+static void record(int op, void *ptr, void *old, size_t size, size_t arg)
+{
+    ring_t *r = self;
+    event_t *e;
+    size_t tail;
+
+    if (r == NULL && (r = self = ring_acquire()) == NULL)
+	return;
+    tail = r->tail;
+    while (tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == RING_SIZE) {
+	if (__atomic_load_n(&stopping, __ATOMIC_RELAXED))
+	    return;
+	sched_yield();
+    }
+    e = &r->ev[tail & (RING_SIZE - 1)];
+    e->op = op;
+    e->ptr = ptr;
+    e->old = old;
+    e->size = size;
+    e->arg = arg;
+
+    __atomic_store_n(&r->inflight, __atomic_load_n(&next_seq, __ATOMIC_SEQ_CST),
+		     __ATOMIC_SEQ_CST);
+    e->seq = __atomic_fetch_add(&next_seq, 1, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&r->inflight, NO_SEQ, __ATOMIC_RELEASE);
+}
+
+static int traced(void)
+{
+    if (in_tracer)
+	return 0;
+    if (real_malloc == NULL)
+	resolve();
+    return __atomic_load_n(&tracing, __ATOMIC_RELAXED);
+}
+
+EXPORT void *malloc(size_t size)
+{
+    void *p;
+
+    if (in_tracer && real_malloc == NULL)
+	return boot_alloc(size);
+    if (!traced())
+	return real_malloc(size);
+    p = real_malloc(size);
+    record(OP_MALLOC, p, NULL, size, 0);
+    return p;
+}
+
+EXPORT void free(void *ptr)
+{
+    if (ptr == NULL || is_boot(ptr))
+	return;
+    if (traced())
+	record(OP_FREE, ptr, NULL, 0, 0);
+    real_free(ptr);
+}
+
+EXPORT void *calloc(size_t nmemb, size_t size)
+{
+    void *p;
+
+    /* dlsym asks for memory with calloc; the arena is zeroed */
+    if (in_tracer && real_calloc == NULL)
+	return nmemb > BOOT_SIZE || size > BOOT_SIZE ? NULL : boot_alloc(nmemb * size);
+    if (!traced())
+	return real_calloc(nmemb, size);
+    p = real_calloc(nmemb, size);
+    record(OP_CALLOC, p, NULL, size, nmemb);
+    return p;
+}
+
+EXPORT void *realloc(void *ptr, size_t size)
+{
+    void *p;
+
+    if (is_boot(ptr)) {
+	/* Boot blocks are small and never reused, copying too much is safe */
+	if ((p = malloc(size)) != NULL)
+	    memcpy(p, ptr, size < BOOT_SIZE - ((char *)ptr - boot_arena) ?
+		   size : BOOT_SIZE - ((char *)ptr - boot_arena));
+	return p;
+    }
+    if (!traced())
+	return real_realloc(ptr, size);
+    record(OP_REALLOC_BEGIN, ptr, NULL, 0, 0);
+    p = real_realloc(ptr, size);
+    record(OP_REALLOC_END, p, ptr, size, 0);
+    return p;
+}
+
+EXPORT void *reallocarray(void *ptr, size_t nmemb, size_t size)
+{
+    size_t bytes;
+
+    if (__builtin_mul_overflow(nmemb, size, &bytes)) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    return realloc(ptr, bytes);
+}
+
+EXPORT int posix_memalign(void **memptr, size_t align, size_t size)
+{
+    int rc;
+
+    if (!traced())
+	return real_posix_memalign(memptr, align, size);
+    rc = real_posix_memalign(memptr, align, size);
+    record(OP_MEMALIGN, rc == 0 ? *memptr : NULL, NULL, size, align);
+    return rc;
+}
+
+EXPORT void *memalign(size_t align, size_t size)
+{
+    void *p;
+
+    if (!traced())
+	return real_memalign(align, size);
+    p = real_memalign(align, size);
+    record(OP_MEMALIGN, p, NULL, size, align);
+    return p;
+}
+
+EXPORT void *aligned_alloc(size_t align, size_t size)
+{
+    return memalign(align, size);
+}
+
+EXPORT void *valloc(size_t size)
+{
+    return memalign(sysconf(_SC_PAGESIZE), size);
+}
+
+EXPORT void *pvalloc(size_t size)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+
+    return memalign(page, (size + page - 1) & ~(page - 1));
+}
+
+/*******************************
+ * Writer side (one thread)
+ *******************************/
+
+static void out_flush(void)
+{
+    size_t done = 0;
+    ssize_t n;
+
+    if (out_gz != NULL)
+	gzwrite(out_gz, out_buf, out_len);
+    else
+	while (done < out_len) {
+	    if ((n = write(out_fd, out_buf + done, out_len - done)) <= 0) {
+		if (n < 0 && errno == EINTR)
+		    continue;
+		break;
+	    }
+	    done += n;
+	}
+    out_len = 0;
+}
+
+static void out_line(const char *fmt, unsigned a, size_t b, size_t c)
+{
+    if (out_len > OUT_SIZE - 64)
+	out_flush();
+    out_len += sprintf(out_buf + out_len, fmt, a, b, c);
+    num_ops++;
+}
+
+static size_t hash_ptr(void *ptr)
+{
+    return ((uintptr_t)ptr >> 4) * 0x9e3779b97f4a7c15ULL >> 16;
+}
+
+static slot_t *table_find(void *ptr)
+{
+    size_t i;
+
+    for (i = hash_ptr(ptr) & table_mask; table[i].ptr != NULL; i = (i + 1) & table_mask)
+	if (table[i].ptr == ptr)
+	    return &table[i];
+    return NULL;
+}
+
+static void table_put(void *ptr, unsigned id, size_t size)
+{
+    size_t i;
+
+    for (i = hash_ptr(ptr) & table_mask; table[i].ptr != NULL; i = (i + 1) & table_mask)
+	;
+    table[i].ptr = ptr;
+    table[i].id = id;
+    table[i].size = size;
+}
+
+static void table_insert(void *ptr, unsigned id, size_t size)
+{
+    slot_t *old = table;
+    size_t i, n = table_mask + 1;
+
+    /* Keep the table at most half full */
+    if (2 * (table_used + 1) > n) {
+	if ((table = calloc(2 * n, sizeof(slot_t))) == NULL)
+	    abort();
+	table_mask = 2 * n - 1;
+	for (i = 0; i < n; i++)
+	    if (old[i].ptr != NULL)
+		table_put(old[i].ptr, old[i].id, old[i].size);
+	free(old);
+    }
+    table_put(ptr, id, size);
+    table_used++;
+    live_bytes += size;
+    if (live_bytes > peak_bytes)
+	peak_bytes = live_bytes;
+}
+
+/* table_remove - linear probing, so later entries of the run move back */
+static void table_remove(slot_t *s)
+{
+    size_t i = s - table, j = i, k;
+
+    live_bytes -= s->size;
+    table_used--;
+    for (;;) {
+	table[i].ptr = NULL;
+	for (;;) {
+	    j = (j + 1) & table_mask;
+	    if (table[j].ptr == NULL)
+		return;
+	    k = hash_ptr(table[j].ptr) & table_mask;
+	    /* Stop at an entry whose home is not between i and j */
+	    if (i <= j ? (i >= k || k > j) : (i >= k && k > j))
+		break;
+	}
+	table[i] = table[j];
+	i = j;
+    }
+}
+
+/* new_block - give ptr a new id and write its allocation */
+static void new_block(event_t *e, size_t size)
+{
+    unsigned id;
+
+    if (e->ptr == NULL || size > MAX_BLOCK)
+	return;
+    if (size == 0)
+	size = 1;
+    id = num_ids++;
+    table_insert(e->ptr, id, size);
+    if (e->op == OP_CALLOC && e->arg <= MAX_BLOCK && e->size <= MAX_BLOCK)
+	out_line("c %u %zu %zu\n", id, e->arg, size / e->arg);
+    else if (e->op == OP_MEMALIGN)
+	out_line("m %u %zu %zu\n", id, e->arg, size);
+    else
+	out_line("a %u %zu\n", id, size, 0);
+}
+
+/* write_event - turn one event into trace lines */
+static void write_event(ring_t *r, event_t *e)
+{
+    slot_t *s;
+    size_t size;
+
+    switch (e->op) {
+    case OP_MALLOC:
+    case OP_MEMALIGN:
+	new_block(e, e->size);
+	break;
+    case OP_CALLOC:
+	/* calloc(n, 0) and calloc(0, n) become one 1-byte block */
+	if (__builtin_mul_overflow(e->arg, e->size, &size))
+	    break;
+	if (size == 0) {
+	    e->op = OP_MALLOC;
+	    size = 1;
+	}
+	new_block(e, size);
+	break;
+    case OP_FREE:
+	if ((s = table_find(e->ptr)) != NULL) {
+	    out_line("f %u\n", s->id, 0, 0);
+	    table_remove(s);
+	}
+	break;
+    case OP_REALLOC_BEGIN:
+	/* The old address may be handed out again before the END event */
+	r->moving = 0;
+	if (e->ptr != NULL && (s = table_find(e->ptr)) != NULL) {
+	    r->moving = 1;
+	    r->moving_id = s->id;
+	    r->moving_size = s->size;
+	    table_remove(s);
+	    live_bytes += r->moving_size;
+	}
+	break;
+    case OP_REALLOC_END:
+	if (!r->moving) {
+	    e->op = OP_MALLOC;
+	    new_block(e, e->size);
+	    break;
+	}
+	r->moving = 0;
+	live_bytes -= r->moving_size;
+	if (e->ptr == NULL && e->size == 0)   /* realloc(p, 0) frees p */
+	    out_line("f %u\n", r->moving_id, 0, 0);
+	else if (e->ptr == NULL)              /* failed, p is still live */
+	    table_insert(e->old, r->moving_id, r->moving_size);
+	else if (e->size == 0 || e->size > MAX_BLOCK) {
+	    /* glibc returns a block for realloc(p, 0); mdriver cannot */
+	    out_line("f %u\n", r->moving_id, 0, 0);
+	    new_block(e, e->size);
+	}
+	else {
+	    table_insert(e->ptr, r->moving_id, e->size);
+	    out_line("r %u %zu\n", r->moving_id, e->size, 0);
+	}
+	break;
+    }
+}
+
+/*
+ * drain - write every published event older than any event still being
+ *     published, merging the rings by sequence number. Each ring is in
+ *     sequence order, so the writer takes a run from the ring with the
+ *     oldest head until another ring's head is older. Returns the number
+ *     of events written.
+ */
+static size_t drain(void)
+{
+    uint64_t limit, s, best_seq, next_best;
+    ring_t *r, *best;
+    size_t head, n = 0;
+
+    limit = __atomic_load_n(&next_seq, __ATOMIC_SEQ_CST);
+    for (r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r != NULL; r = r->next)
+	if ((s = __atomic_load_n(&r->inflight, __ATOMIC_SEQ_CST)) < limit)
+	    limit = s;
+
+    for (;;) {
+	best = NULL;
+	best_seq = next_best = limit;
+	for (r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r != NULL; r = r->next) {
+	    if (r->head == __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE))
+		continue;
+	    s = r->ev[r->head & (RING_SIZE - 1)].seq;
+	    if (s < best_seq) {
+		next_best = best_seq;
+		best_seq = s;
+		best = r;
+	    }
+	    else if (s < next_best)
+		next_best = s;
+	}
+	if (best == NULL)
+	    return n;
+	for (head = best->head; head != __atomic_load_n(&best->tail, __ATOMIC_ACQUIRE) &&
+		 best->ev[head & (RING_SIZE - 1)].seq < next_best; head++, n++)
+	    write_event(best, &best->ev[head & (RING_SIZE - 1)]);
+	__atomic_store_n(&best->head, head, __ATOMIC_RELEASE);
+    }
+}
+
+static void *writer_main(void *arg)
+{
+    struct timespec nap = { 0, 1000000 };
+
+    in_tracer = 1;
+    while (!__atomic_load_n(&stopping, __ATOMIC_ACQUIRE))
+	if (drain() == 0)
+	    nanosleep(&nap, NULL);
+    drain();
+    return NULL;
+}
+
+/*
+ * header_text - the four header lines, each padded to HDR_FIELD so the
+ *     final header takes exactly the room of the placeholder
+ */
+static void header_text(char *buf)
+{
+    char tmp[HDR_LEN + 1];
+    unsigned heap = peak_bytes > INT_MAX ? INT_MAX : peak_bytes;
+
+    snprintf(tmp, sizeof(tmp), "%-*u\n%-*u\n%-*u\n%-*u\n", HDR_FIELD, heap,
+	     HDR_FIELD, num_ids, HDR_FIELD, num_ops, HDR_FIELD, 1u);
+    memcpy(buf, tmp, HDR_LEN);
+}
+
+/*
+ * header_member - wrap the header text in a gzip member holding one
+ *     stored deflate block, so its length does not depend on the values
+ */
+static size_t header_member(unsigned char *buf)
+{
+    static const unsigned char gz_head[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3 };
+    unsigned char *p = buf;
+    uLong crc;
+
+    memcpy(p, gz_head, sizeof(gz_head));
+    p += sizeof(gz_head);
+    *p++ = 1;                                  /* final block, stored */
+    *p++ = HDR_LEN & 0xff;
+    *p++ = HDR_LEN >> 8;
+    *p++ = ~HDR_LEN & 0xff;
+    *p++ = (~HDR_LEN >> 8) & 0xff;
+    header_text((char *)p);
+    crc = crc32(crc32(0, NULL, 0), p, HDR_LEN);
+    p += HDR_LEN;
+    *p++ = crc;  *p++ = crc >> 8;  *p++ = crc >> 16;  *p++ = crc >> 24;
+    *p++ = HDR_LEN;  *p++ = HDR_LEN >> 8;  *p++ = 0;  *p++ = 0;
+    return p - buf;
+}
+
+static void write_header(int compressed)
+{
+    unsigned char buf[64 + HDR_LEN];
+    size_t len;
+
+    if (compressed)
+	len = header_member(buf);
+    else {
+	header_text((char *)buf);
+	len = HDR_LEN;
+    }
+    if (pwrite(out_fd, buf, len, 0) != (ssize_t)len)
+	perror("mmtrace: header");
+}
+
+static void trace_child(void)
+{
+    tracing = 0;
+}
+
+__attribute__((constructor))
+static void trace_start(void)
+{
+    char name[PATH_MAX];
+    const char *fmt = getenv("MMTRACE_FILE");
+    int compressed, fd;
+    size_t len = 0;
+
+    in_tracer++;
+    if (real_malloc == NULL)
+	resolve();
+    if (fmt == NULL || *fmt == '\0')
+	fmt = "mmtrace.%p.rep";
+    for (; *fmt != '\0' && len < sizeof(name) - 16; fmt++)
+	if (fmt[0] == '%' && fmt[1] == 'p')
+	    len += sprintf(name + len, "%d", (int)getpid()), fmt++;
+	else
+	    name[len++] = *fmt;
+    name[len] = '\0';
+    compressed = len > 3 && strcmp(name + len - 3, ".gz") == 0;
+
+    if ((out_fd = open(name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0) {
+	perror("mmtrace: open");
+	goto out;
+    }
+    write_header(compressed);
+    lseek(out_fd, 0, SEEK_END);
+    /* Level 1: the writer has to keep up with the traced program */
+    if (compressed && ((fd = fcntl(out_fd, F_DUPFD_CLOEXEC, 0)) < 0 || (out_gz = gzdopen(fd, "wb1")) == NULL)) {
+	perror("mmtrace: gzdopen");
+	goto out;
+    }
+    table_mask = 1023;
+    if ((table = calloc(table_mask + 1, sizeof(slot_t))) == NULL ||
+	pthread_key_create(&ring_key, ring_release) != 0 ||
+	pthread_atfork(NULL, NULL, trace_child) != 0 ||
+	pthread_create(&writer, NULL, writer_main, NULL) != 0) {
+	perror("mmtrace: start");
+	goto out;
+    }
+    __atomic_store_n(&tracing, 1, __ATOMIC_RELEASE);
+ out:
+    in_tracer--;
+}
+
+__attribute__((destructor))
+static void trace_stop(void)
+{
+    if (!__atomic_load_n(&tracing, __ATOMIC_ACQUIRE))
+	return;
+    in_tracer++;
+    __atomic_store_n(&tracing, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&stopping, 1, __ATOMIC_RELEASE);
+    pthread_join(writer, NULL);
+    out_flush();
+    if (out_gz != NULL)
+	gzclose(out_gz);
+    write_header(out_gz != NULL);
+    close(out_fd);
+    in_tracer--;
+}
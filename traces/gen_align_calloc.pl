@@ -0,0 +1,75 @@
+#!/usr/bin/perl
+#!/usr/local/bin/perl
+
+#
+# gen_align_calloc.pl - generate align-calloc-bal.rep: calloc [c] and
+#    memalign [m] requests mixed with plain mallocs and random frees.
+#    Alignments run from 16 bytes to 4KB; a tenth of the memaligns and
+#    a twentieth of the callocs are large. One 1GB alignment, more than
+#    any heap can hold with its slack, comes before the final frees.
+#    srand fixes the sequence, so the trace is the same on every run.
+#
+$out_filename = "align-calloc-bal.rep";
+$num_steps = 6000;
+$max_live = 400;
+srand(12);
+
+@aligns = (16, 32, 64, 128, 4096);
+@nmembs = (1, 4, 16, 64, 256);
+@member_sizes = (4, 8, 12, 24, 40);
+
+# Create trace
+$num_blocks = 0;
+for ($i = 0; $i < $num_steps; $i += 1) {
+    if (@live && (rand() < 0.45 || @live > $max_live)) {
+        $j = int(rand @live);
+        push @trace, "f $live[$j]";
+        splice @live, $j, 1;
+        next;
+    }
+    $kind = rand;
+    if ($kind < 0.35) {
+        $nmemb = $nmembs[int(rand @nmembs)];
+        $size = $member_sizes[int(rand @member_sizes)];
+        $nmemb *= 64 if rand() < 0.05;
+        push @trace, "c $num_blocks $nmemb $size";
+    } elsif ($kind < 0.7) {
+        $align = $aligns[int(rand @aligns)];
+        if (rand() < 0.9) {
+            $size = 1 + int(rand 6000);
+        } else {
+            $size = 100000 + int(rand 300000);
+        }
+        push @trace, "m $num_blocks $align $size";
+    } else {
+        $size = 1 + int(rand 3000);
+        push @trace, "a $num_blocks $size";
+    }
+    push @live, $num_blocks;
+    $num_blocks += 1;
+}
+push @trace, "m $num_blocks 1073741824 64";
+push @trace, "f $num_blocks";
+$num_blocks += 1;
+# Free what is still live
+foreach $id (@live) {
+    push @trace, "f $id";
+}
+
+# Open output file
+open OUTFILE, ">$out_filename" or die "Cannot create $out_filename\n";
+
+# Calculate misc parameters
+$suggested_heap_size = 20000;
+$num_ops = scalar @trace;
+
+print OUTFILE "$suggested_heap_size\n";
+print OUTFILE "$num_blocks\n";
+print OUTFILE "$num_ops\n";
+print OUTFILE "1\n";
+
+foreach $line (@trace) {
+    print OUTFILE "$line\n";
+}
+
+close OUTFILE;
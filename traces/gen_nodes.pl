@@ -0,0 +1,93 @@
+#!/usr/bin/perl
+#!/usr/local/bin/perl
+
+#
+# gen_nodes.pl - generate nodes-batch-bal.rep and nodes-single-bal.rep,
+#    a node-pool workload. Each round allocates 6 groups of 32, 64 or
+#    128 equal-sized nodes, frees the 2 groups kept from the round
+#    before, and keeps 2 of the new groups. The batch trace allocates
+#    and frees a group with one b/B line; the single trace writes the
+#    same requests as a/f lines, one per node. srand fixes the
+#    sequence, so both traces are the same on every run.
+#
+$num_rounds = 60;
+$groups_per_round = 6;
+$groups_kept = 2;
+srand(13);
+
+@group_sizes = (32, 64, 128);
+@node_sizes = (24, 40, 72, 136, 320, 600, 1100);
+
+# Create trace: "b <id> <n> <size>" and "B <id> <n>" entries
+$num_blocks = 0;
+for ($i = 0; $i < $num_rounds; $i += 1) {
+    @new = ();
+    for ($j = 0; $j < $groups_per_round; $j += 1) {
+        $n = $group_sizes[int(rand @group_sizes)];
+        $size = $node_sizes[int(rand @node_sizes)];
+        push @trace, "b $num_blocks $n $size";
+        push @new, "$num_blocks $n";
+        $num_blocks += $n;
+    }
+    # Shuffle the new groups, then keep the first ones for a round
+    for ($j = $#new; $j > 0; $j -= 1) {
+        $k = int(rand($j + 1));
+        @new[$j, $k] = @new[$k, $j];
+    }
+    foreach $group (@kept) {
+        push @trace, "B $group";
+    }
+    @kept = splice @new, 0, $groups_kept;
+    foreach $group (@new) {
+        push @trace, "B $group";
+    }
+}
+foreach $group (@kept) {
+    push @trace, "B $group";
+}
+
+write_trace("nodes-batch-bal.rep", 0);
+write_trace("nodes-single-bal.rep", 1);
+
+#
+# write_trace(name, single) - write the trace to name, with each batch
+#    entry split into one a or f line per node when single is set
+#
+sub write_trace
+{
+    my ($out_filename, $single) = @_;
+    my (@lines, $line, $type, $id, $n, $size, $k);
+
+    foreach $line (@trace) {
+        ($type, $id, $n, $size) = split / /, $line;
+        if (!$single) {
+            push @lines, $line;
+        } elsif ($type eq "b") {
+            for ($k = 0; $k < $n; $k += 1) {
+                push @lines, "a " . ($id + $k) . " $size";
+            }
+        } else {
+            for ($k = 0; $k < $n; $k += 1) {
+                push @lines, "f " . ($id + $k);
+            }
+        }
+    }
+
+    # Open output file
+    open OUTFILE, ">$out_filename" or die "Cannot create $out_filename\n";
+
+    # Calculate misc parameters
+    $suggested_heap_size = 20000;
+    $num_ops = scalar @lines;
+
+    print OUTFILE "$suggested_heap_size\n";
+    print OUTFILE "$num_blocks\n";
+    print OUTFILE "$num_ops\n";
+    print OUTFILE "1\n";
+
+    foreach $line (@lines) {
+        print OUTFILE "$line\n";
+    }
+
+    close OUTFILE;
+}